@@ -0,0 +1,111 @@
+// Description: Keyframed camera path for rendering a sequence of frames in one run.
+//              Values between two keyframes are interpolated linearly.
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "vec3.h"
+#include "camera.h"
+#include "include/json.hpp"
+#include <algorithm>
+#include <vector>
+using namespace std;
+
+struct CameraKey {
+    int   frame = 0;
+    vec3  position, look_at;
+    float fov = 1.0f;
+    float focus_dist = 1.0f;
+};
+
+// Keyframed center of one sphere
+struct SphereTrack {
+    uint32_t sphere = 0;                  // index into Scene::spheres
+    vector<pair<int, vec3>> keys;         // (frame, center), sorted by frame
+
+    vec3 center_at(int frame) const {
+        if (frame <= keys.front().first) return keys.front().second;
+        for (size_t i = 1; i < keys.size(); ++i) {
+            if (frame <= keys[i].first) {
+                const auto& [f0, c0] = keys[i - 1];
+                const auto& [f1, c1] = keys[i];
+                return c0 + (c1 - c0) * (float(frame - f0) / float(f1 - f0));
+            }
+        }
+        return keys.back().second;
+    }
+};
+
+struct Animation {
+    int frames = 0;               // 0 = no animation, render a single frame
+    vector<CameraKey> keys;       // sorted by frame, empty = camera does not move
+    vector<SphereTrack> sphere_tracks;
+    float rebuild_threshold = 1.5f;   // rebuild the BVH once its SAH cost grew by this factor
+
+    bool enabled() const { return frames > 0; }
+
+    // Camera for 'frame': lerp between the surrounding keys, aperture, seed and shutter come from 'base'
+    Camera camera_at(int frame, const Camera& base) const {
+        if (keys.empty()) return base;
+        auto lerp = [](auto a, auto b, float t) { return a + (b - a) * t; };
+        const CameraKey* a = &keys.front();
+        const CameraKey* b = &keys.front();
+        for (const CameraKey& k : keys) {
+            if (k.frame <= frame) a = &k;
+            if (k.frame >= frame) { b = &k; break; }
+            b = &k;
+        }
+        float t = b->frame > a->frame ? float(frame - a->frame) / float(b->frame - a->frame) : 0.f;
+        Camera cam(lerp(a->position, b->position, t), lerp(a->look_at, b->look_at, t),
+                   lerp(a->fov, b->fov, t), base.aperture, lerp(a->focus_dist, b->focus_dist, t));
+        cam.seed = base.seed;
+        cam.shutter_open = base.shutter_open;
+        cam.shutter_close = base.shutter_close;
+        return cam;
+    }
+};
+
+// "animation": {"frames": N, "keyframes": [{"frame": 0, "position": [..], "look_at": [..],
+//               "fov": f, "focus_dist": d}, ...]}
+// Keys that leave out a value keep the one from the previous key (the first key uses 'base').
+inline Animation parse_animation(const nlohmann::json& a, const Camera& base) {
+    Animation anim;
+    anim.frames = a.value("frames", 0);
+    anim.rebuild_threshold = a.value("rebuild_threshold", anim.rebuild_threshold);
+    if (!a.contains("keyframes")) return anim;
+
+    CameraKey prev;
+    prev.position   = base.position;
+    prev.look_at    = base.position + base.forward;
+    prev.fov        = base.fov;
+    prev.focus_dist = base.focus_dist;
+    auto read_vec3 = [](const nlohmann::json& v) { return vec3{v[0], v[1], v[2]}; };
+
+    vector<nlohmann::json> sorted(a["keyframes"].begin(), a["keyframes"].end());
+    stable_sort(sorted.begin(), sorted.end(),
+                [](const nlohmann::json& x, const nlohmann::json& y) { return x.value("frame", 0) < y.value("frame", 0); });
+    for (const auto& k : sorted) {
+        CameraKey key = prev;
+        key.frame = k.value("frame", 0);
+        if (k.contains("position"))   key.position   = read_vec3(k["position"]);
+        if (k.contains("look_at"))    key.look_at    = read_vec3(k["look_at"]);
+        if (k.contains("fov"))        key.fov        = k["fov"];
+        if (k.contains("focus_dist")) key.focus_dist = k["focus_dist"];
+        anim.keys.push_back(key);
+        prev = key;
+    }
+    return anim;
+}
+
+// Sphere entry with "keyframes": [{"frame": 0, "center": [..]}, ...]
+inline SphereTrack parse_sphere_track(uint32_t sphere, const nlohmann::json& keyframes) {
+    SphereTrack track;
+    track.sphere = sphere;
+    for (const auto& k : keyframes) {
+        track.keys.emplace_back(k.value("frame", 0), vec3{k["center"][0], k["center"][1], k["center"][2]});
+    }
+    stable_sort(track.keys.begin(), track.keys.end(),
+                [](const auto& x, const auto& y) { return x.first < y.first; });
+    return track;
+}
+
+#endif
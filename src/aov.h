@@ -0,0 +1,145 @@
+// Description: Arbitrary output variables (AOVs): depth, world normal, first-hit albedo and
+//              object id of the camera rays, and the per-pixel sample variance. They are
+//              filled by the same cast_ray calls as the color, and only the selected
+//              passes get a buffer.
+#ifndef AOV_H
+#define AOV_H
+
+#include "scene.h"
+#include "render.h"
+#include "image.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+
+enum AovPass : unsigned {
+    AOV_DEPTH    = 1u << 0,
+    AOV_NORMAL   = 1u << 1,
+    AOV_ALBEDO   = 1u << 2,
+    AOV_ID       = 1u << 3,
+    AOV_VARIANCE = 1u << 4,
+};
+
+// "depth,normal,albedo,id,variance" (or "all") -> AovPass mask
+inline unsigned parse_aov_list(const string& list) {
+    unsigned mask = 0;
+    stringstream ss(list);
+    for (string name; getline(ss, name, ',');) {
+        if (name == "depth") mask |= AOV_DEPTH;
+        else if (name == "normal") mask |= AOV_NORMAL;
+        else if (name == "albedo") mask |= AOV_ALBEDO;
+        else if (name == "id") mask |= AOV_ID;
+        else if (name == "variance") mask |= AOV_VARIANCE;
+        else if (name == "all") mask |= AOV_DEPTH | AOV_NORMAL | AOV_ALBEDO | AOV_ID | AOV_VARIANCE;
+        else if (!name.empty()) throw runtime_error("unknown AOV " + name + " (depth, normal, albedo, id, variance)");
+    }
+    return mask;
+}
+
+struct AovBuffers {
+    unsigned mask = 0;
+    int width = 0, height = 0;
+    vector<float> depth;        // 0 where nothing was hit
+    vector<vec3> normal;
+    vector<vec3> albedo;
+    vector<int32_t> id;         // sphere index, FLOOR_OBJECT_ID or NO_OBJECT_ID
+    vector<float> variance;     // of the pixel's mean luminance, 0 with spp = 1
+
+    AovBuffers() = default;
+    AovBuffers(unsigned mask_, int width_, int height_) : mask(mask_), width(width_), height(height_) {
+        size_t n = size_t(width) * height;
+        if (mask & AOV_DEPTH) depth.resize(n);
+        if (mask & AOV_NORMAL) normal.resize(n);
+        if (mask & AOV_ALBEDO) albedo.resize(n);
+        if (mask & AOV_ID) id.resize(n);
+        if (mask & AOV_VARIANCE) variance.resize(n);
+    }
+
+    void store(size_t pix, const AovSample& a) {
+        if (mask & AOV_DEPTH) depth[pix] = a.depth;
+        if (mask & AOV_NORMAL) normal[pix] = a.normal;
+        if (mask & AOV_ALBEDO) albedo[pix] = a.albedo;
+        if (mask & AOV_ID) id[pix] = a.object_id;
+        if (mask & AOV_VARIANCE) variance[pix] = a.variance;
+    }
+};
+
+// render() plus the selected AOVs in the same pass
+inline void render_with_aovs(const Scene& scene, vector<vec3>& framebuffer, AovBuffers& aovs) {
+    const int width = scene.width, height = scene.height;
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int pix = 0; pix < width * height; ++pix) {
+        AovSample aov;
+        framebuffer[pix] = render_pixel(scene, pix, &aov);
+        aovs.store(pix, aov);
+    }
+}
+
+// Stable, well spread color per object id for the id preview
+inline vec3 id_color(int32_t id) {
+    if (id == NO_OBJECT_ID) return {0, 0, 0};
+    uint32_t h = hash_u32(uint32_t(id) * 0x9e3779b9u + 1);
+    return vec3{float(h & 0xff), float((h >> 8) & 0xff), float((h >> 16) & 0xff)} * (1.f / 255);
+}
+
+// <prefix>_<pass>.pfm with the exact values and <prefix>_<pass>.png to look at:
+// depth scaled to the farthest hit (near = bright), normal * 0.5 + 0.5, albedo as is,
+// variance as relative standard deviation, id as false colors.
+inline void save_aovs(const string& prefix, const AovBuffers& aovs) {
+    const int w = aovs.width, h = aovs.height;
+    const size_t n = size_t(w) * h;
+    vector<vec3> img(n);
+    if (aovs.mask & AOV_DEPTH) {
+        float far_d = 0;
+        for (float d : aovs.depth) far_d = max(far_d, d);
+        for (size_t i = 0; i < n; ++i) {
+            float d = aovs.depth[i];
+            img[i] = vec3{d, d, d};
+        }
+        save_pfm(prefix + "_depth.pfm", w, h, img);
+        for (size_t i = 0; i < n; ++i) {
+            float v = aovs.depth[i] > 0 ? 1.f - aovs.depth[i] / max(far_d, 1e-6f) * 0.9f : 0.f;
+            img[i] = vec3{v, v, v};
+        }
+        save_png(prefix + "_depth.png", w, h, img);
+    }
+    if (aovs.mask & AOV_NORMAL) {
+        save_pfm(prefix + "_normal.pfm", w, h, aovs.normal);
+        for (size_t i = 0; i < n; ++i) img[i] = aovs.normal[i] * 0.5f + vec3{0.5f, 0.5f, 0.5f};
+        save_png(prefix + "_normal.png", w, h, img);
+    }
+    if (aovs.mask & AOV_ALBEDO) {
+        save_pfm(prefix + "_albedo.pfm", w, h, aovs.albedo);
+        save_png(prefix + "_albedo.png", w, h, aovs.albedo);
+    }
+    if (aovs.mask & AOV_VARIANCE) {
+        float peak = 0;
+        for (float v : aovs.variance) peak = max(peak, v);
+        for (size_t i = 0; i < n; ++i) {
+            float v = aovs.variance[i];
+            img[i] = vec3{v, v, v};
+        }
+        save_pfm(prefix + "_variance.pfm", w, h, img);
+        for (size_t i = 0; i < n; ++i) {
+            float v = sqrt(aovs.variance[i] / max(peak, 1e-12f));      // stddev relative to the noisiest pixel
+            img[i] = vec3{v, v, v};
+        }
+        save_png(prefix + "_variance.png", w, h, img);
+    }
+    if (aovs.mask & AOV_ID) {
+        for (size_t i = 0; i < n; ++i) {
+            float v = float(aovs.id[i]);
+            img[i] = vec3{v, v, v};
+        }
+        save_pfm(prefix + "_id.pfm", w, h, img);
+        for (size_t i = 0; i < n; ++i) img[i] = id_color(aovs.id[i]);
+        save_png(prefix + "_id.png", w, h, img);
+    }
+}
+
+#endif
@@ -2,47 +2,135 @@
 #define BACKGROUND_H
 
 #include "vec3.h"
+#include "texture_cache.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <vector>
 using namespace std;
 
+struct EnvDistribution;     // envlight.h
+
+// How rays look up the envmap: nearest texel (the default), bilinear, or mipmapped by ray cone
+enum class EnvFilter { Nearest, Bilinear, Cone };
+
+inline EnvFilter env_filter_by_name(const string& name) {
+    if (name == "nearest") return EnvFilter::Nearest;
+    if (name == "bilinear") return EnvFilter::Bilinear;
+    if (name == "cone") return EnvFilter::Cone;
+    throw runtime_error("unknown envmap filter " + name + " (nearest, bilinear or cone)");
+}
+
+// One level of the envmap pyramid, RGB8 like the decoded image
+struct EnvMipLevel {
+    int width = 0, height = 0;
+    vector<unsigned char> rgb;
+};
+
 struct Background {
     vec3 color; // fallback color
+    string path; // envmap file, empty when only the color is used
     unsigned char* image_data = nullptr;
+    shared_ptr<TiledTexture> tiled;     // .rttx envmap, read through the texture cache instead of image_data
     int width = 0, height = 0, channels = 0;
 
-    vec3 sample(const vec3& dir) const {
-    if (!image_data) return color;
+    // Image-based lighting: the envmap also lights the surfaces, ibl_samples directions per
+    // shading point. 0 = the envmap is only seen by rays that miss.
+    int ibl_samples = 0;
+    float ibl_intensity = 1.f;
+    shared_ptr<const EnvDistribution> ibl;     // built with the decoded image when ibl_samples > 0
 
-    // 使用世界方向 dir 直接计算球面坐标
-    vec3 d = dir.normalized();
+    EnvFilter filter = EnvFilter::Nearest;
+    shared_ptr<const vector<EnvMipLevel>> mips;    // levels 1, 2, ... down to 1 pixel high, for Cone
 
-    // φ: azimuth angle (longitude), measured around Y axis, in range [-π, π]
-    // 方位角，表示在水平面上绕 Y 轴旋转的角度
-    float phi   = atan2(-d.z, d.x);    // be careful with '-d.z'
+    // Envmap uv of a world direction, u in [0, 1) around Y, v in [0, 1] from +Y down
+    static void direction_to_uv(const vec3& dir, float& u, float& v) {
+        // 使用世界方向 dir 直接计算球面坐标
+        vec3 d = dir.normalized();
 
-    // θ: polar angle (colatitude), angle from Y axis (up), in range [0, π]
-    // 极角，表示与 Y 轴夹角
-    float theta = acos(clamp(d.y, -1.f, 1.f));
+        // φ: azimuth angle (longitude), measured around Y axis, in range [-π, π]
+        // 方位角，表示在水平面上绕 Y 轴旋转的角度
+        float phi   = atan2(-d.z, d.x);    // be careful with '-d.z'
 
-    // 转换为 [0,1] 的 UV 坐标
-    float u = (phi + M_PI) / (2 * M_PI);
-    u = u + 0.25f;                        // + 0.25f to move to the center
-    if (u >= 1.0f) u -= 1.0f;
-    if (u < 0.0f)  u += 1.0f;
+        // θ: polar angle (colatitude), angle from Y axis (up), in range [0, π]
+        // 极角，表示与 Y 轴夹角
+        float theta = acos(clamp(d.y, -1.f, 1.f));
 
-    float v = theta / M_PI;
+        // 转换为 [0,1] 的 UV 坐标
+        u = (phi + M_PI) / (2 * M_PI);
+        u = u + 0.25f;                        // + 0.25f to move to the center
+        if (u >= 1.0f) u -= 1.0f;
+        if (u < 0.0f)  u += 1.0f;
 
-    // UV coordinates to pixel coordinates (x, y)
-    int x = min(int(u * width), width - 1);
-    int y = min(int(v * height), height - 1);
-    int idx = (y * width + x) * 3;
+        v = theta / M_PI;
+    }
 
-    return vec3{
-        image_data[idx]     / 255.f,
-        image_data[idx + 1] / 255.f,
-        image_data[idx + 2] / 255.f
-    };
-}
+    bool has_image() const { return image_data || tiled; }
+
+    vec3 sample(const vec3& dir) const {
+        if (!has_image()) return color;
+        float u, v;
+        direction_to_uv(dir, u, v);
+
+        // UV coordinates to pixel coordinates (x, y)
+        int x = min(int(u * width), width - 1);
+        int y = min(int(v * height), height - 1);
+        const unsigned char* p = tiled ? tiled->texel(0, x, y) : image_data + (y * width + x) * 3;
+
+        return vec3{
+            p[0] / 255.f,
+            p[1] / 255.f,
+            p[2] / 255.f
+        };
+    }
+
+    // Filtered lookup for a ray cone that spreads 'spread' radians. Bilinear reads the full
+    // image. Cone reads the mip level whose texels are about as wide as the cone (and blends
+    // two levels), so blurry reflections read small levels that stay in cache.
+    vec3 sample(const vec3& dir, float spread) const {
+        if (!has_image() || filter == EnvFilter::Nearest) return sample(dir);
+        float u, v;
+        direction_to_uv(dir, u, v);
+        const int levels = tiled ? tiled->num_levels() - 1 : mips ? int(mips->size()) : 0;
+        float lod = 0;
+        if (filter == EnvFilter::Cone && spread > 0) {
+            lod = clamp(log2(spread * width / (2.f * float(M_PI))), 0.f, float(levels));
+        }
+        int l0 = int(lod);
+        float t = lod - l0;
+        vec3 c = bilinear(l0, u, v);
+        if (t > 0 && l0 < levels) c = c * (1 - t) + bilinear(l0 + 1, u, v) * t;
+        return c;
+    }
+
+    // Bilinear fetch from mip level 'level' (0 = full size), wrapping around in u
+    vec3 bilinear(int level, float u, float v) const {
+        const unsigned char* data = image_data;
+        int w = width, h = height;
+        if (tiled) {
+            w = tiled->level_width(level);
+            h = tiled->level_height(level);
+        } else if (level > 0) {
+            const EnvMipLevel& m = (*mips)[level - 1];
+            data = m.rgb.data();
+            w = m.width;
+            h = m.height;
+        }
+        float fx = u * w - 0.5f, fy = v * h - 0.5f;
+        int x0 = int(floor(fx)), y0 = int(floor(fy));
+        float tx = fx - x0, ty = fy - y0;
+        int xa = (x0 % w + w) % w, xb = (xa + 1) % w;
+        int ya = clamp(y0, 0, h - 1), yb = clamp(y0 + 1, 0, h - 1);
+        auto texel = [&](int x, int y) {
+            const unsigned char* p = tiled ? tiled->texel(level, x, y) : data + (size_t(y) * w + x) * 3;
+            return vec3{float(p[0]), float(p[1]), float(p[2])};
+        };
+        vec3 top = texel(xa, ya) * (1 - tx) + texel(xb, ya) * tx;
+        vec3 bottom = texel(xa, yb) * (1 - tx) + texel(xb, yb) * tx;
+        return (top * (1 - ty) + bottom * ty) * (1.f / 255);
+    }
 
 
     /*If you dont want rotate background with camPos, use this*/
@@ -79,4 +167,21 @@ struct Background {
     // }
 };
 
+// Box-filtered pyramid below the decoded image of bg (downsample_rgb8) down to 1 pixel high
+inline shared_ptr<const vector<EnvMipLevel>> build_env_mips(const Background& bg) {
+    if (!bg.image_data) return nullptr;
+    auto levels = make_shared<vector<EnvMipLevel>>();
+    const unsigned char* src = bg.image_data;
+    int sw = bg.width, sh = bg.height;
+    while (sh > 1) {
+        EnvMipLevel m;
+        m.rgb = downsample_rgb8(src, sw, sh, m.width, m.height);
+        levels->push_back(move(m));
+        src = levels->back().rgb.data();
+        sw = levels->back().width;
+        sh = levels->back().height;
+    }
+    return levels;
+}
+
 #endif
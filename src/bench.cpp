@@ -0,0 +1,166 @@
+// Benchmark suite: renders procedurally generated scenes over a grid of
+// configurations and reports median time, spread and Mrays/s.
+//
+// Build: g++ -std=c++17 -fopenmp -O2 -DRT_RAY_STATS -o bench src/bench.cpp
+// Usage: ./bench [--runs N] [--size WxH] [--spheres 16,128] [--lights 1,4]
+//                [--mix diffuse,mixed,glass] [--dof 0,1] [--depth 1,4,10]
+//                [--seed S] [--label name] [--out out/bench.json]
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <filesystem>
+#include <sstream>
+#include <omp.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "include/stb_image.h"
+#include "include/json.hpp"
+using json = nlohmann::json;
+
+#include "scene.h"
+#include "scenegen.h"
+#include "render.h"
+
+using namespace std;
+
+int depthMax;
+
+#ifndef RT_RAY_STATS
+#error "bench must be built with -DRT_RAY_STATS"
+#endif
+
+// "1,4,10" -> {1, 4, 10}
+template <typename T>
+static vector<T> parse_list(const string& s) {
+    vector<T> out;
+    stringstream ss(s);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (item.empty()) continue;
+        if constexpr (is_same_v<T, string>) out.push_back(item);
+        else out.push_back(static_cast<T>(stoi(item)));
+    }
+    return out;
+}
+
+// Sum the per-thread ray counters and reset them for the next run
+static unsigned long long collect_ray_count() {
+    unsigned long long total = 0;
+#pragma omp parallel reduction(+:total)
+    {
+        total += ray_stats_count;
+        ray_stats_count = 0;
+    }
+    return total;
+}
+
+int main(int argc, char* argv[]) {
+    int runs = 5;
+    int width = 320, height = 240;
+    vector<int> sphere_counts = {16, 128};
+    vector<int> light_counts  = {1, 4};
+    vector<string> mixes      = {"mixed"};
+    vector<int> dofs          = {0, 1};
+    vector<int> depths        = {1, 4};
+    uint32_t seed = 1;
+    string label = "";
+    string out_path = "out/bench.json";
+
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        if (i + 1 >= argc) { cerr << "Missing value for " << a << "\n"; return 1; }
+        string v = argv[++i];
+        try {
+            if      (a == "--runs")    runs = stoi(v);
+            else if (a == "--size")    { width = stoi(v); height = stoi(v.substr(v.find('x') + 1)); }
+            else if (a == "--spheres") sphere_counts = parse_list<int>(v);
+            else if (a == "--lights")  light_counts = parse_list<int>(v);
+            else if (a == "--mix")     mixes = parse_list<string>(v);
+            else if (a == "--dof")     dofs = parse_list<int>(v);
+            else if (a == "--depth")   depths = parse_list<int>(v);
+            else if (a == "--seed")    seed = stoul(v);
+            else if (a == "--label")   label = v;
+            else if (a == "--out")     out_path = v;
+            else { cerr << "Unknown option " << a << "\n"; return 1; }
+        } catch (...) {
+            cerr << "Bad value for " << a << ": " << v << "\n";
+            return 1;
+        }
+    }
+    for (int d : depths) {
+        if (d < 0 || d > 100) { cerr << "Invalid depth " << d << "\n"; return 1; }
+    }
+    if (runs < 1) runs = 1;
+
+    json results = json::array();
+    printf("%8s %7s %8s %4s %6s | %10s %10s %8s %10s\n",
+           "spheres", "lights", "mix", "dof", "depth", "median ms", "spread %", "Mrays", "Mrays/s");
+
+    for (int ns : sphere_counts)
+    for (int nl : light_counts)
+    for (const string& mix : mixes)
+    for (int dof : dofs)
+    for (int depth : depths) {
+        SceneGenParams p;
+        p.num_spheres = ns;
+        p.num_lights  = nl;
+        p.mix         = mix;
+        p.dof         = dof != 0;
+        p.width       = width;
+        p.height      = height;
+        p.seed        = seed;
+        Scene scene = generate_scene(p);
+        prepare_bvh(scene, "");           // always build, the build is not part of the timing
+        depthMax = depth;
+
+        vector<vec3> framebuffer(width * height);
+        render(scene, framebuffer);       // warm-up, also primes the thread pool
+        collect_ray_count();
+
+        vector<double> times_ms;
+        unsigned long long rays = 0;
+        for (int r = 0; r < runs; ++r) {
+            auto t0 = chrono::high_resolution_clock::now();
+            render(scene, framebuffer);
+            auto t1 = chrono::high_resolution_clock::now();
+            times_ms.push_back(chrono::duration<double, milli>(t1 - t0).count());
+            rays = collect_ray_count();
+        }
+
+        vector<double> sorted = times_ms;
+        sort(sorted.begin(), sorted.end());
+        size_t n = sorted.size();
+        double median = n % 2 ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+        double spread = median > 0 ? 100.0 * (sorted.back() - sorted.front()) / median : 0.0;
+        double mrays_per_s = median > 0 ? rays / (median * 1e3) : 0.0;
+
+        printf("%8d %7d %8s %4d %6d | %10.2f %10.1f %8.2f %10.2f\n",
+               ns, nl, mix.c_str(), dof, depth, median, spread, rays / 1e6, mrays_per_s);
+        fflush(stdout);
+
+        results.push_back({
+            {"spheres", ns}, {"lights", nl}, {"mix", mix}, {"dof", dof != 0}, {"depth", depth},
+            {"runs_ms", times_ms},
+            {"median_ms", median}, {"min_ms", sorted.front()}, {"max_ms", sorted.back()},
+            {"spread_pct", spread},
+            {"rays", rays}, {"mrays_per_s", mrays_per_s}
+        });
+    }
+
+    json report = {
+        {"label", label},
+        {"width", width}, {"height", height},
+        {"runs", runs}, {"seed", seed},
+        {"threads", omp_get_max_threads()},
+        {"results", results}
+    };
+    filesystem::path out_file(out_path);
+    if (out_file.has_parent_path()) filesystem::create_directories(out_file.parent_path());
+    ofstream ofs(out_path);
+    ofs << report.dump(2) << "\n";
+    cout << "Results written to " << out_path << endl;
+    return 0;
+}
@@ -0,0 +1,525 @@
+// Description: Bounding volume hierarchy over the spheres (binned SAH build),
+//              and its on-disk cache keyed by a hash of the geometry.
+//
+// Nodes live in one flat array in depth-first order and only refer to each other
+// by index, so a built tree can be written to disk and used straight from a
+// memory mapped file on later runs.
+#ifndef BVH_H
+#define BVH_H
+
+#include "vec3.h"
+#include "sphere.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct BVHNode {
+    vec3 lo, hi;          // bounding box
+    uint32_t first;       // leaf: first entry in prim_indices / inner: index of the right child
+    uint32_t count;       // leaf: number of spheres / inner: 0 (left child is the next node)
+};
+static_assert(sizeof(BVHNode) == 32, "BVHNode is written to the cache as raw bytes");
+
+// Leaves are at most this deep (the root is depth 0). Traversal keeps at most one pending
+// sibling per level, so its fixed stack of BVH_MAX_DEPTH + 1 entries cannot overflow.
+constexpr int BVH_MAX_DEPTH = 63;
+
+struct BVHBounds {
+    vec3 lo, hi;
+};
+
+// The arrays either live in the own_* vectors or inside a mapped cache file.
+// Move only: the raw pointers stay valid when the owning storage is moved.
+struct BVH {
+    const BVHNode*  nodes = nullptr;
+    const uint32_t* prim_indices = nullptr;
+    uint32_t node_count = 0, prim_count = 0;
+
+    // Motion blur: node boxes hold the bounds at shutter open, end_bounds the bounds at
+    // shutter close (same order as nodes). A ray at time t tests the lerp of both.
+    const BVHBounds* end_bounds = nullptr;     // null for static scenes
+    float shutter_open = 0, shutter_close = 0;
+
+    vector<BVHNode>   own_nodes;
+    vector<uint32_t>  own_prims;
+    vector<BVHBounds> own_end_bounds;
+    MappedFile        mapped;
+
+    // Refit bookkeeping, filled on the first refit_bvh() call
+    vector<uint32_t> parent;        // parent node of each node (root: UINT32_MAX)
+    vector<uint32_t> prim_leaf;     // leaf node holding each sphere
+    double sah_sum = 0;             // sum of node_sah_weight() over all nodes
+    double built_sah_sum = 0;       // sah_sum right after the build (before any refit)
+
+    BVH() = default;
+    BVH(BVH&&) = default;
+    BVH& operator=(BVH&&) = default;
+
+    bool empty() const { return node_count == 0; }
+};
+
+inline void sphere_bounds(const Sphere& s, vec3& lo, vec3& hi) {
+    vec3 r = {s.radius, s.radius, s.radius};
+    lo = s.center - r;
+    hi = s.center + r;
+}
+
+// Bounds of a moving sphere at shutter time t
+inline void sphere_bounds(const Sphere& s, float t, vec3& lo, vec3& hi) {
+    vec3 r = {s.radius, s.radius, s.radius};
+    vec3 c = s.center_at(t);
+    lo = c - r;
+    hi = c + r;
+}
+
+inline bool has_motion(const vector<Sphere>& spheres) {
+    for (const Sphere& s : spheres) {
+        if (s.velocity.x != 0 || s.velocity.y != 0 || s.velocity.z != 0) return true;
+    }
+    return false;
+}
+
+inline float box_area(const vec3& lo, const vec3& hi) {
+    vec3 d = hi - lo;
+    return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+inline void grow(vec3& lo, vec3& hi, const vec3& plo, const vec3& phi) {
+    lo = {min(lo.x, plo.x), min(lo.y, plo.y), min(lo.z, plo.z)};
+    hi = {max(hi.x, phi.x), max(hi.y, phi.y), max(hi.z, phi.z)};
+}
+
+/*----------------- Build (binned SAH) -----------------*/
+namespace bvh_detail {
+
+constexpr int BINS = 16;
+constexpr uint32_t MAX_LEAF = 4;
+
+struct Builder {
+    const vector<Sphere>& spheres;
+    vector<BVHNode>& nodes;
+    vector<uint32_t>& prims;
+
+    void build(uint32_t begin, uint32_t end, int depth) {
+        uint32_t node_idx = uint32_t(nodes.size());
+        nodes.push_back({});
+
+        vec3 lo = {FLT_MAX, FLT_MAX, FLT_MAX}, hi = -lo;       // node bounds
+        vec3 clo = lo, chi = hi;                               // centroid bounds
+        for (uint32_t i = begin; i < end; ++i) {
+            vec3 plo, phi;
+            sphere_bounds(spheres[prims[i]], plo, phi);
+            grow(lo, hi, plo, phi);
+            grow(clo, chi, spheres[prims[i]].center, spheres[prims[i]].center);
+        }
+        nodes[node_idx].lo = lo;
+        nodes[node_idx].hi = hi;
+
+        uint32_t n = end - begin;
+        int axis = 0;
+        vec3 extent = chi - clo;
+        if (extent.y > extent[axis]) axis = 1;
+        if (extent.z > extent[axis]) axis = 2;
+        if (n <= MAX_LEAF || extent[axis] <= 0.f || depth >= BVH_MAX_DEPTH) {
+            nodes[node_idx].first = begin;
+            nodes[node_idx].count = n;
+            return;
+        }
+
+        // Bin centroids along the widest axis, pick the split with the lowest SAH cost
+        struct Bin { vec3 lo = {FLT_MAX, FLT_MAX, FLT_MAX}, hi = {-FLT_MAX, -FLT_MAX, -FLT_MAX}; uint32_t count = 0; };
+        Bin bins[BINS];
+        float scale = BINS / extent[axis];
+        auto bin_of = [&](uint32_t prim) {
+            return min(BINS - 1, int((spheres[prim].center[axis] - clo[axis]) * scale));
+        };
+        for (uint32_t i = begin; i < end; ++i) {
+            Bin& b = bins[bin_of(prims[i])];
+            vec3 plo, phi;
+            sphere_bounds(spheres[prims[i]], plo, phi);
+            grow(b.lo, b.hi, plo, phi);
+            ++b.count;
+        }
+        float right_area[BINS];
+        uint32_t right_count[BINS];
+        {
+            vec3 rlo = bins[BINS - 1].lo, rhi = bins[BINS - 1].hi;
+            uint32_t rc = 0;
+            for (int b = BINS - 1; b > 0; --b) {
+                grow(rlo, rhi, bins[b].lo, bins[b].hi);
+                rc += bins[b].count;
+                right_area[b] = rc ? box_area(rlo, rhi) : 0.f;
+                right_count[b] = rc;
+            }
+        }
+        float best_cost = FLT_MAX;
+        int best_split = -1;
+        vec3 llo = bins[0].lo, lhi = bins[0].hi;
+        uint32_t lc = 0;
+        for (int b = 1; b < BINS; ++b) {
+            grow(llo, lhi, bins[b - 1].lo, bins[b - 1].hi);
+            lc += bins[b - 1].count;
+            if (lc == 0 || right_count[b] == 0) continue;
+            float cost = lc * box_area(llo, lhi) + right_count[b] * right_area[b];
+            if (cost < best_cost) { best_cost = cost; best_split = b; }
+        }
+
+        uint32_t mid;
+        if (best_split < 0) {
+            mid = begin + n / 2;
+            nth_element(prims.begin() + begin, prims.begin() + mid, prims.begin() + end,
+                        [&](uint32_t a, uint32_t b) { return spheres[a].center[axis] < spheres[b].center[axis]; });
+        } else {
+            mid = uint32_t(partition(prims.begin() + begin, prims.begin() + end,
+                                     [&](uint32_t p) { return bin_of(p) < best_split; }) - prims.begin());
+        }
+
+        build(begin, mid, depth + 1);                        // left child = node_idx + 1
+        nodes[node_idx].first = uint32_t(nodes.size());      // right child
+        nodes[node_idx].count = 0;
+        build(mid, end, depth + 1);
+    }
+};
+
+} // namespace bvh_detail
+
+inline BVH build_bvh(const vector<Sphere>& spheres) {
+    BVH bvh;
+    if (spheres.empty()) return bvh;
+    bvh.own_prims.resize(spheres.size());
+    for (uint32_t i = 0; i < spheres.size(); ++i) bvh.own_prims[i] = i;
+    bvh.own_nodes.reserve(2 * spheres.size());
+    bvh_detail::Builder{spheres, bvh.own_nodes, bvh.own_prims}.build(0, uint32_t(spheres.size()), 0);
+
+    bvh.nodes = bvh.own_nodes.data();
+    bvh.prim_indices = bvh.own_prims.data();
+    bvh.node_count = uint32_t(bvh.own_nodes.size());
+    bvh.prim_count = uint32_t(bvh.own_prims.size());
+    return bvh;
+}
+
+
+/*----------------- Refit -----------------*/
+// SAH cost weight of one node: traversal cost 1 for inner nodes, one intersection per sphere in leaves
+inline double node_sah_weight(const BVHNode& n) {
+    return double(box_area(n.lo, n.hi)) * (n.count > 0 ? n.count : 1);
+}
+
+// SAH cost growth since the build: 1 = as good as a fresh tree. Boxes get looser
+// while spheres travel away from where the tree was built, so this only goes up.
+// (Not normalized by the root area: a growing root would hide the loose children.)
+inline double bvh_sah_growth(const BVH& bvh) {
+    return bvh.built_sah_sum > 0 ? bvh.sah_sum / bvh.built_sah_sum : 1.0;
+}
+
+// Refit needs writable nodes: copy a tree that is mapped from the cache into own storage
+inline void make_bvh_owned(BVH& bvh) {
+    if (!bvh.mapped.is_open()) return;
+    bvh.own_nodes.assign(bvh.nodes, bvh.nodes + bvh.node_count);
+    bvh.own_prims.assign(bvh.prim_indices, bvh.prim_indices + bvh.prim_count);
+    if (bvh.end_bounds) {
+        bvh.own_end_bounds.assign(bvh.end_bounds, bvh.end_bounds + bvh.node_count);
+        bvh.end_bounds = bvh.own_end_bounds.data();
+    }
+    bvh.nodes = bvh.own_nodes.data();
+    bvh.prim_indices = bvh.own_prims.data();
+    bvh.mapped.close();
+}
+
+// Turn the tree into a motion tree for the shutter interval [t0, t1]: node boxes get
+// the bounds at t0, end_bounds the bounds at t1. The topology is kept as built.
+// Both bounds move linearly with the spheres, so their lerp at time t contains every
+// sphere of the node at t. Children come after their parent, so one backward pass works.
+inline void set_bvh_motion(BVH& bvh, const vector<Sphere>& spheres, float t0, float t1) {
+    if (bvh.empty()) return;
+    make_bvh_owned(bvh);
+    vector<BVHNode>& nodes = bvh.own_nodes;
+    bvh.own_end_bounds.resize(nodes.size());
+    for (uint32_t i = bvh.node_count; i-- > 0;) {
+        BVHNode& n = nodes[i];
+        BVHBounds& e = bvh.own_end_bounds[i];
+        if (n.count > 0) {
+            n.lo = e.lo = {FLT_MAX, FLT_MAX, FLT_MAX};
+            n.hi = e.hi = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+            for (uint32_t k = n.first; k < n.first + n.count; ++k) {
+                vec3 plo, phi;
+                sphere_bounds(spheres[bvh.own_prims[k]], t0, plo, phi);
+                grow(n.lo, n.hi, plo, phi);
+                sphere_bounds(spheres[bvh.own_prims[k]], t1, plo, phi);
+                grow(e.lo, e.hi, plo, phi);
+            }
+        } else {
+            const BVHNode& l = nodes[i + 1];
+            const BVHNode& r = nodes[n.first];
+            n.lo = l.lo; n.hi = l.hi;
+            grow(n.lo, n.hi, r.lo, r.hi);
+            const BVHBounds& le = bvh.own_end_bounds[i + 1];
+            const BVHBounds& re = bvh.own_end_bounds[n.first];
+            e = le;
+            grow(e.lo, e.hi, re.lo, re.hi);
+        }
+    }
+    bvh.end_bounds = bvh.own_end_bounds.data();
+    bvh.shutter_open = t0;
+    bvh.shutter_close = t1;
+
+    bvh.sah_sum = 0;
+    for (const BVHNode& n : nodes) bvh.sah_sum += node_sah_weight(n);
+    if (bvh.built_sah_sum == 0) bvh.built_sah_sum = bvh.sah_sum;
+}
+
+// Update the boxes after the spheres in 'moved' changed position or radius.
+// Only the leaves holding those spheres and their ancestors are touched, a walk stops
+// as soon as a box does not change. The tree topology stays the same, so its quality
+// drops when spheres travel far (check bvh_sah_growth() and rebuild when needed).
+inline void refit_bvh(BVH& bvh, const vector<Sphere>& spheres, const vector<uint32_t>& moved) {
+    if (bvh.empty()) return;
+    if (bvh.end_bounds) {          // motion trees keep two boxes per node, refit both in one pass
+        set_bvh_motion(bvh, spheres, bvh.shutter_open, bvh.shutter_close);
+        return;
+    }
+    make_bvh_owned(bvh);
+    vector<BVHNode>& nodes = bvh.own_nodes;
+
+    if (bvh.parent.size() != nodes.size()) {
+        bvh.parent.assign(nodes.size(), UINT32_MAX);
+        bvh.prim_leaf.assign(spheres.size(), 0);
+        bvh.sah_sum = 0;
+        for (uint32_t i = 0; i < nodes.size(); ++i) {
+            const BVHNode& n = nodes[i];
+            bvh.sah_sum += node_sah_weight(n);
+            if (n.count > 0) {
+                for (uint32_t k = n.first; k < n.first + n.count; ++k) bvh.prim_leaf[bvh.own_prims[k]] = i;
+            } else {
+                bvh.parent[i + 1] = i;
+                bvh.parent[n.first] = i;
+            }
+        }
+        if (bvh.built_sah_sum == 0) bvh.built_sah_sum = bvh.sah_sum;
+    }
+
+    auto set_box = [&](uint32_t idx, const vec3& lo, const vec3& hi) {
+        BVHNode& n = nodes[idx];
+        if (n.lo.x == lo.x && n.lo.y == lo.y && n.lo.z == lo.z &&
+            n.hi.x == hi.x && n.hi.y == hi.y && n.hi.z == hi.z) return false;
+        bvh.sah_sum -= node_sah_weight(n);
+        n.lo = lo;
+        n.hi = hi;
+        bvh.sah_sum += node_sah_weight(n);
+        return true;
+    };
+
+    for (uint32_t prim : moved) {
+        uint32_t idx = bvh.prim_leaf[prim];
+        const BVHNode& leaf = nodes[idx];
+        vec3 lo = {FLT_MAX, FLT_MAX, FLT_MAX}, hi = -lo;
+        for (uint32_t k = leaf.first; k < leaf.first + leaf.count; ++k) {
+            vec3 plo, phi;
+            sphere_bounds(spheres[bvh.own_prims[k]], plo, phi);
+            grow(lo, hi, plo, phi);
+        }
+        if (!set_box(idx, lo, hi)) continue;
+        while (bvh.parent[idx] != UINT32_MAX) {
+            idx = bvh.parent[idx];
+            const BVHNode& l = nodes[idx + 1];
+            const BVHNode& r = nodes[nodes[idx].first];
+            vec3 plo = l.lo, phi = l.hi;
+            grow(plo, phi, r.lo, r.hi);
+            if (!set_box(idx, plo, phi)) break;
+        }
+    }
+}
+
+/*----------------- Traversal -----------------*/
+// Slab test, returns the entry distance or FLT_MAX when the box is missed (or farther than tmax)
+inline float hit_box(const vec3& lo, const vec3& hi, const vec3& orig, const vec3& inv_dir, float tmax) {
+    float tx0 = (lo.x - orig.x) * inv_dir.x, tx1 = (hi.x - orig.x) * inv_dir.x;
+    float ty0 = (lo.y - orig.y) * inv_dir.y, ty1 = (hi.y - orig.y) * inv_dir.y;
+    float tz0 = (lo.z - orig.z) * inv_dir.z, tz1 = (hi.z - orig.z) * inv_dir.z;
+    float t_near = max(max(min(tx0, tx1), min(ty0, ty1)), max(min(tz0, tz1), 0.f));
+    float t_far  = min(min(max(tx0, tx1), max(ty0, ty1)), min(max(tz0, tz1), tmax));
+    return t_near <= t_far ? t_near : FLT_MAX;
+}
+
+// Box of node i at shutter time 'time' (the plain node box for static trees)
+inline float hit_node(const BVH& bvh, uint32_t i, float time, const vec3& orig, const vec3& inv_dir, float tmax) {
+    const BVHNode& n = bvh.nodes[i];
+    if (!bvh.end_bounds) return hit_box(n.lo, n.hi, orig, inv_dir, tmax);
+    float span = bvh.shutter_close - bvh.shutter_open;
+    float u = span > 0 ? (time - bvh.shutter_open) / span : 0.f;
+    const BVHBounds& e = bvh.end_bounds[i];
+    return hit_box(n.lo + (e.lo - n.lo) * u, n.hi + (e.hi - n.hi) * u, orig, inv_dir, tmax);
+}
+
+// Nearest sphere hit closer than 'nearest_dist' at shutter time 'time'. Updates
+// nearest_dist and returns the sphere index, or -1 if nothing closer was found.
+inline int bvh_intersect(const BVH& bvh, const vector<Sphere>& spheres,
+                         const vec3& orig, const vec3& dir, float& nearest_dist, float time = 0.f) {
+    vec3 inv_dir = {1.f / dir.x, 1.f / dir.y, 1.f / dir.z};
+    int hit_idx = -1;
+    uint32_t stack[BVH_MAX_DEPTH + 1];
+    int sp = 0;
+    if (hit_node(bvh, 0, time, orig, inv_dir, nearest_dist) == FLT_MAX) return -1;
+    stack[sp++] = 0;
+    while (sp > 0) {
+        const BVHNode& node = bvh.nodes[stack[--sp]];
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                uint32_t prim = bvh.prim_indices[i];
+                auto [hit, dist] = ray_sphere_intersect(orig, dir, spheres[prim], time);
+                // same tie-break as the linear loop: lower sphere index wins
+                if (hit && (dist < nearest_dist || (dist == nearest_dist && int(prim) < hit_idx))) {
+                    nearest_dist = dist;
+                    hit_idx = int(prim);
+                }
+            }
+            continue;
+        }
+        uint32_t left = uint32_t(&node - bvh.nodes) + 1, right = node.first;
+        float tl = hit_node(bvh, left, time, orig, inv_dir, nearest_dist);
+        float tr = hit_node(bvh, right, time, orig, inv_dir, nearest_dist);
+        // push the farther child first so the nearer one is visited next
+        if (tl > tr) { swap(tl, tr); swap(left, right); }
+        if (tr != FLT_MAX) stack[sp++] = right;
+        if (tl != FLT_MAX) stack[sp++] = left;
+    }
+    return hit_idx;
+}
+
+/*----------------- Cache file -----------------*/
+// Layout: BVHCacheHeader | BVHNode[node_count] | uint32_t[prim_count]
+//         | BVHBounds[node_count] (only for motion trees)
+constexpr char     BVH_CACHE_MAGIC[4] = {'R', 'T', 'B', 'V'};
+constexpr uint32_t BVH_CACHE_VERSION  = 2;
+constexpr size_t   BVH_CACHE_MIN_SPHERES = 4096;   // smaller scenes build faster than a file open
+
+struct BVHCacheHeader {
+    char     magic[4];
+    uint32_t version;
+    uint64_t geometry_hash;
+    uint32_t num_spheres, node_count, prim_count, has_motion;
+    float    shutter_open, shutter_close;
+};
+
+// FNV-1a, also used to key other caches
+inline uint64_t fnv1a64(const void* data, size_t bytes, uint64_t h = 1469598103934665603ULL) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < bytes; ++i) { h ^= p[i]; h *= 1099511628211ULL; }
+    return h;
+}
+
+// Hash of centers, radii, velocities and the shutter interval: any change of the geometry
+// gives a new cache file. Materials are not part of the key, they do not affect the tree.
+inline uint64_t geometry_hash(const vector<Sphere>& spheres, float shutter_open = 0, float shutter_close = 0) {
+    uint64_t n = spheres.size();
+    uint64_t h = fnv1a64(&n, sizeof(n));
+    for (const Sphere& s : spheres) {
+        h = fnv1a64(&s.center, sizeof(vec3), h);
+        h = fnv1a64(&s.radius, sizeof(float), h);
+        h = fnv1a64(&s.velocity, sizeof(vec3), h);
+    }
+    h = fnv1a64(&shutter_open, sizeof(float), h);
+    h = fnv1a64(&shutter_close, sizeof(float), h);
+    return h;
+}
+
+inline string bvh_cache_path(const string& cache_dir, uint64_t hash) {
+    char name[32];
+    snprintf(name, sizeof(name), "bvh-%016llx.bin", static_cast<unsigned long long>(hash));
+    return (filesystem::path(cache_dir) / name).string();
+}
+
+// Check a tree read from disk before traversal trusts it: leaves reference valid spheres,
+// children come after their parent in the array (so there are no cycles) and no leaf is
+// deeper than BVH_MAX_DEPTH.
+inline bool bvh_nodes_valid(const BVHNode* nodes, uint32_t node_count, const uint32_t* prims,
+                            uint32_t prim_count, size_t num_spheres) {
+    for (uint32_t k = 0; k < prim_count; ++k) {
+        if (prims[k] >= num_spheres) return false;
+    }
+    vector<uint8_t> depth(node_count, 0);
+    for (uint32_t i = 0; i < node_count; ++i) {
+        const BVHNode& n = nodes[i];
+        if (n.count > 0) {
+            if (uint64_t(n.first) + n.count > prim_count) return false;
+            continue;
+        }
+        if (depth[i] >= BVH_MAX_DEPTH || n.first <= i + 1 || n.first >= node_count) return false;
+        for (uint32_t child : {i + 1, n.first}) depth[child] = max(depth[child], uint8_t(depth[i] + 1));
+    }
+    return true;
+}
+
+// Map a cached tree. Returns an empty BVH when the file is missing, does not match or
+// is corrupt.
+inline BVH load_bvh_cache(const string& path, uint64_t hash, size_t num_spheres) {
+    BVH bvh;
+    MappedFile file(path);
+    if (!file.is_open() || file.size() < sizeof(BVHCacheHeader)) return bvh;
+    BVHCacheHeader h;
+    memcpy(&h, file.data(), sizeof(h));
+    size_t expected = sizeof(h) + size_t(h.node_count) * sizeof(BVHNode) + size_t(h.prim_count) * sizeof(uint32_t)
+                    + (h.has_motion ? size_t(h.node_count) * sizeof(BVHBounds) : 0);
+    if (memcmp(h.magic, BVH_CACHE_MAGIC, 4) != 0 || h.version != BVH_CACHE_VERSION ||
+        h.geometry_hash != hash || h.num_spheres != num_spheres || h.prim_count != num_spheres ||
+        h.node_count == 0 || file.size() != expected) {
+        return bvh;
+    }
+    bvh.nodes = reinterpret_cast<const BVHNode*>(file.data() + sizeof(h));
+    bvh.prim_indices = reinterpret_cast<const uint32_t*>(file.data() + sizeof(h) + h.node_count * sizeof(BVHNode));
+    if (!bvh_nodes_valid(bvh.nodes, h.node_count, bvh.prim_indices, h.prim_count, num_spheres)) return BVH();
+    bvh.node_count = h.node_count;
+    bvh.prim_count = h.prim_count;
+    if (h.has_motion) {
+        bvh.end_bounds = reinterpret_cast<const BVHBounds*>(file.data() + sizeof(h) + h.node_count * sizeof(BVHNode)
+                                                            + h.prim_count * sizeof(uint32_t));
+        bvh.shutter_open = h.shutter_open;
+        bvh.shutter_close = h.shutter_close;
+    }
+    bvh.mapped = std::move(file);
+    return bvh;
+}
+
+// Write to a temp file and rename, so a crashed or concurrent run never leaves a torn cache
+inline bool save_bvh_cache(const string& path, const BVH& bvh, uint64_t hash) {
+    BVHCacheHeader h;
+    memset(static_cast<void*>(&h), 0, sizeof(h));
+    memcpy(h.magic, BVH_CACHE_MAGIC, 4);
+    h.version       = BVH_CACHE_VERSION;
+    h.geometry_hash = hash;
+    h.num_spheres   = bvh.prim_count;
+    h.node_count    = bvh.node_count;
+    h.prim_count    = bvh.prim_count;
+    h.has_motion    = bvh.end_bounds != nullptr;
+    h.shutter_open  = bvh.shutter_open;
+    h.shutter_close = bvh.shutter_close;
+
+    filesystem::path p(path);
+    if (p.has_parent_path()) filesystem::create_directories(p.parent_path());
+    string tmp = path + ".tmp" + to_string(chrono::steady_clock::now().time_since_epoch().count());
+    {
+        ofstream out(tmp, ios::binary);
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(reinterpret_cast<const char*>(bvh.nodes), streamsize(bvh.node_count * sizeof(BVHNode)));
+        out.write(reinterpret_cast<const char*>(bvh.prim_indices), streamsize(bvh.prim_count * sizeof(uint32_t)));
+        if (bvh.end_bounds) {
+            out.write(reinterpret_cast<const char*>(bvh.end_bounds), streamsize(bvh.node_count * sizeof(BVHBounds)));
+        }
+        if (!out) { filesystem::remove(tmp); return false; }
+    }
+    error_code ec;
+    filesystem::rename(tmp, path, ec);
+    if (ec) filesystem::remove(tmp, ec);
+    return !ec;
+}
+
+#endif
@@ -3,20 +3,40 @@
 
 #include "vec3.h"
 #include <cmath>
-#include <cstdlib>
+#include <cstdint>
 
 using namespace std;
 
-inline float randf() {
-    return rand() / (RAND_MAX + 1.0f);
+// Integer hash (lowbias32), used as a stateless random generator
+inline uint32_t hash_u32(uint32_t x) {
+    x ^= x >> 16; x *= 0x7feb352dU;
+    x ^= x >> 15; x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
 }
 
+// Reproducible random stream for one pixel: same seed + pixel -> same numbers,
+// no matter which thread renders the pixel or in which order.
+struct PixelRng {
+    uint32_t state;
+    PixelRng(uint32_t pix, uint32_t seed, uint32_t sample = 0)
+        : state(hash_u32(pix ^ hash_u32(seed + sample * 0x9e3779b9U))) {}
+
+    float next() {                         // uniform in [0, 1)
+        state = hash_u32(state + 0x9e3779b9U);
+        return (state >> 8) * (1.f / 16777216.f);
+    }
+};
+
 struct Camera {
     vec3 position;
     vec3 right, up, forward;
     float fov = 1.0f;
     float aperture = 0.0f;    // 光圈半径 / Aperture radius
     float focus_dist = 1.0f;  // 焦点距离 / Focus distance
+    uint32_t seed = 0;        // 随机种子 / Seed of the aperture samples
+    float shutter_open = 0.0f;   // 快门时间 / Shutter interval for motion blur,
+    float shutter_close = 0.0f;  // open == close means no blur
 
     Camera(const vec3& pos = {0, 0, 0}, const vec3& look_at = {0, 0, -1},
            float fov_ = 1.0f, 
@@ -31,8 +51,13 @@ struct Camera {
     vec3 get_ray_dir(int pix, int width, int height) const {
         int i = pix % width;
         int j = pix / width;
-        float dir_x =  (i + 0.5f) - width / 2.f;
-        float dir_y = -(j + 0.5f) + height / 2.f;
+        return get_ray_dir(i + 0.5f, j + 0.5f, width, height);
+    }
+
+    // Through film position (x, y) in pixels, (i + 0.5, j + 0.5) is the center of pixel (i, j)
+    vec3 get_ray_dir(float x, float y, int width, int height) const {
+        float dir_x =  x - width / 2.f;
+        float dir_y = -y + height / 2.f;
         float dir_z = height / (2.f * tan(fov / 2.f));
         return (forward * dir_z + right * dir_x + up * dir_y).normalized();
     }
@@ -48,11 +73,14 @@ struct Camera {
 
     // 带景深的光线生成函数：光圈扰动发射点，指向焦平面
     // DOF-enabled ray: jitter origin inside aperture, aim at focus plane
-    void get_ray_with_dof(int pix, int width, int height, vec3& ray_orig, vec3& ray_dir) const {
-        vec3 base_dir = get_ray_dir(pix, width, height);
+    void get_ray_with_dof(int pix, int width, int height, PixelRng& rng, vec3& ray_orig, vec3& ray_dir) const {
+        float r1 = rng.next(), r2 = rng.next();
+        get_ray_with_dof(get_ray_dir(pix, width, height), r1, r2, ray_orig, ray_dir);
+    }
 
+    // Same for a given pinhole direction and lens sample (r1, r2) in [0, 1)^2
+    void get_ray_with_dof(const vec3& base_dir, float r1, float r2, vec3& ray_orig, vec3& ray_dir) const {
         // 光圈随机偏移（在 XY 平面内）
-        float r1 = randf(), r2 = randf();
         float theta = 2.0f * M_PI * r1;
         float radius = aperture * sqrt(r2);
         float dx = radius * cos(theta);
@@ -63,6 +91,22 @@ struct Camera {
         ray_orig = position + offset;
         ray_dir = (focus_point - ray_orig).normalized();
     }
+
+    void get_ray_with_dof(int pix, int width, int height, vec3& ray_orig, vec3& ray_dir) const {
+        PixelRng rng(pix, seed);
+        get_ray_with_dof(pix, width, height, rng, ray_orig, ray_dir);
+    }
+
+    // 快门内的随机时刻 / Random time inside the shutter interval
+    float sample_time(PixelRng& rng) const {
+        if (shutter_close <= shutter_open) return shutter_open;
+        return sample_time(rng.next());
+    }
+
+    float sample_time(float u) const {
+        if (shutter_close <= shutter_open) return shutter_open;
+        return shutter_open + (shutter_close - shutter_open) * u;
+    }
 };
 
 #endif
@@ -0,0 +1,166 @@
+// Description: Checkpoint / resume for long renders. The frame is traced one sample index
+//              at a time over blocks of pixels. The running sums and the per-pixel sample
+//              counts are written to disk every few seconds (temp file + rename, never torn).
+//              The count is also the RNG state: sample s of a pixel always uses the stream
+//              (pix, seed, s). A resumed render therefore gives the same bits as an
+//              uninterrupted one.
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "scene.h"
+#include "render.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+constexpr char CHECKPOINT_MAGIC[4] = {'R', 'T', 'C', 'K'};
+constexpr uint32_t CHECKPOINT_VERSION = 1;
+
+// File layout: header, uint32 sample count per pixel, vec3 sum per pixel
+struct CheckpointHeader {
+    char     magic[4];
+    uint32_t version;
+    uint64_t scene_hash;        // scene file content, a changed scene never resumes
+    uint32_t width, height, spp, depth, seed;
+    uint32_t reserved;
+};
+
+struct Checkpoint {
+    uint64_t scene_hash = 0;
+    int width = 0, height = 0, spp = 1, depth = 0;
+    uint32_t seed = 0;
+    vector<uint32_t> samples;   // samples already summed per pixel = next sample index
+    vector<vec3> sum;
+
+    void reset(const Scene& scene, uint64_t hash) {
+        scene_hash = hash;
+        width = scene.width;
+        height = scene.height;
+        spp = scene.spp;
+        depth = depthMax;
+        seed = scene.cam.seed;
+        samples.assign(size_t(width) * height, 0);
+        sum.assign(size_t(width) * height, vec3{0, 0, 0});
+    }
+
+    bool matches(const Scene& scene, uint64_t hash) const {
+        return scene_hash == hash && width == scene.width && height == scene.height && spp == scene.spp &&
+               depth == depthMax && seed == scene.cam.seed;
+    }
+
+    bool complete() const {
+        return all_of(samples.begin(), samples.end(), [&](uint32_t n) { return int(n) >= spp; });
+    }
+};
+
+inline uint64_t file_content_hash(const string& path) {
+    MappedFile file(path);
+    return file.is_open() ? fnv1a64(file.data(), file.size()) : 0;
+}
+
+// Write to a temp file and rename, an interrupted write leaves the previous checkpoint intact
+inline bool save_checkpoint(const string& path, const Checkpoint& ck) {
+    CheckpointHeader h;
+    memset(static_cast<void*>(&h), 0, sizeof(h));
+    memcpy(h.magic, CHECKPOINT_MAGIC, 4);
+    h.version    = CHECKPOINT_VERSION;
+    h.scene_hash = ck.scene_hash;
+    h.width      = ck.width;
+    h.height     = ck.height;
+    h.spp        = ck.spp;
+    h.depth      = ck.depth;
+    h.seed       = ck.seed;
+
+    filesystem::path p(path);
+    if (p.has_parent_path()) filesystem::create_directories(p.parent_path());
+    string tmp = path + ".tmp";
+    {
+        ofstream out(tmp, ios::binary);
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(reinterpret_cast<const char*>(ck.samples.data()), streamsize(ck.samples.size() * sizeof(uint32_t)));
+        out.write(reinterpret_cast<const char*>(ck.sum.data()), streamsize(ck.sum.size() * sizeof(vec3)));
+        out.flush();
+        if (!out) { error_code ec; filesystem::remove(tmp, ec); return false; }
+    }
+    error_code ec;
+    filesystem::rename(tmp, path, ec);
+    if (ec) filesystem::remove(tmp, ec);
+    return !ec;
+}
+
+// False when the file is missing, truncated or from another version
+inline bool load_checkpoint(const string& path, Checkpoint& ck) {
+    MappedFile file(path);
+    if (!file.is_open() || file.size() < sizeof(CheckpointHeader)) return false;
+    CheckpointHeader h;
+    memcpy(&h, file.data(), sizeof(h));
+    size_t pixels = size_t(h.width) * h.height;
+    if (memcmp(h.magic, CHECKPOINT_MAGIC, 4) != 0 || h.version != CHECKPOINT_VERSION ||
+        file.size() != sizeof(h) + pixels * (sizeof(uint32_t) + sizeof(vec3))) {
+        return false;
+    }
+    ck.scene_hash = h.scene_hash;
+    ck.width  = int(h.width);
+    ck.height = int(h.height);
+    ck.spp    = int(h.spp);
+    ck.depth  = int(h.depth);
+    ck.seed   = h.seed;
+    ck.samples.resize(pixels);
+    ck.sum.resize(pixels);
+    memcpy(ck.samples.data(), file.data() + sizeof(h), pixels * sizeof(uint32_t));
+    memcpy(static_cast<void*>(ck.sum.data()), file.data() + sizeof(h) + pixels * sizeof(uint32_t), pixels * sizeof(vec3));
+    return true;
+}
+
+// Set by SIGINT / SIGTERM: the render writes a last checkpoint and stops
+inline volatile sig_atomic_t checkpoint_stop_requested = 0;
+
+inline void request_checkpoint_stop(int) { checkpoint_stop_requested = 1; }
+
+// Trace the samples 'ck' is still missing, checkpointing to 'path' every 'interval' seconds.
+// Returns false if the render was stopped by a signal (the checkpoint is then up to date).
+inline bool render_checkpointed(const Scene& scene, Checkpoint& ck, const string& path, double interval,
+                                vector<vec3>& framebuffer) {
+    const int pixels = scene.width * scene.height;
+    const int block = max(scene.width, 1 << 16);      // pixels between two checkpoint checks
+    auto last_save = chrono::steady_clock::now();
+    auto old_int = signal(SIGINT, request_checkpoint_stop);
+    auto old_term = signal(SIGTERM, request_checkpoint_stop);
+
+    bool stopped = false;
+    int first = *min_element(ck.samples.begin(), ck.samples.end());
+    for (int s = first; s < scene.spp && !stopped; ++s) {
+        for (int begin = 0; begin < pixels; begin += block) {
+            const int end = min(pixels, begin + block);
+#pragma omp parallel for schedule(dynamic, 64)
+            for (int pix = begin; pix < end; ++pix) {
+                if (int(ck.samples[pix]) != s) continue;
+                ck.sum[pix] = ck.sum[pix] + render_sample(scene, pix, s);
+                ck.samples[pix] = s + 1;
+            }
+            auto now = chrono::steady_clock::now();
+            if (checkpoint_stop_requested || chrono::duration<double>(now - last_save).count() >= interval) {
+                if (!save_checkpoint(path, ck)) cerr << "Failed to write checkpoint " << path << "\n";
+                last_save = now;
+            }
+            if (checkpoint_stop_requested) { stopped = true; break; }
+        }
+    }
+    signal(SIGINT, old_int);
+    signal(SIGTERM, old_term);
+    if (stopped) return false;
+
+    for (int pix = 0; pix < pixels; ++pix) framebuffer[pix] = ck.sum[pix] * (1.f / scene.spp);
+    return true;
+}
+
+#endif
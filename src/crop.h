@@ -0,0 +1,58 @@
+// Description: Crop window (region of interest). Only the pixels inside the window are
+//              traced, with the projection of the full frame.
+#ifndef CROP_H
+#define CROP_H
+
+#include "include/json.hpp"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+using namespace std;
+
+// [x0, x1) x [y0, y1), either in pixels or as fractions of the frame (normalized)
+struct CropWindow {
+    float x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    bool normalized = false;
+    bool set = false;
+
+    bool enabled() const { return set; }
+
+    // Pixel rectangle inside a width x height frame. Throws if it is empty.
+    tuple<int, int, int, int> pixels(int width, int height) const {
+        float sx = normalized ? float(width) : 1.f, sy = normalized ? float(height) : 1.f;
+        int px0 = clamp(int(floor(x0 * sx)), 0, width),  py0 = clamp(int(floor(y0 * sy)), 0, height);
+        int px1 = clamp(int(ceil(x1 * sx)), 0, width),   py1 = clamp(int(ceil(y1 * sy)), 0, height);
+        if (px0 >= px1 || py0 >= py1) throw runtime_error("crop window is empty or outside the frame");
+        return {px0, py0, px1, py1};
+    }
+};
+
+// "x0,y0,x1,y1": integers are pixels, values with a decimal point are fractions of the frame
+inline CropWindow parse_crop(const string& spec) {
+    vector<string> parts;
+    stringstream ss(spec);
+    for (string p; getline(ss, p, ',');) parts.push_back(p);
+    if (parts.size() != 4) throw runtime_error("crop must be x0,y0,x1,y1");
+    CropWindow c;
+    c.normalized = spec.find('.') != string::npos;
+    float* v[4] = {&c.x0, &c.y0, &c.x1, &c.y1};
+    for (int i = 0; i < 4; ++i) *v[i] = stof(parts[i]);
+    c.set = true;
+    return c;
+}
+
+// scene.json "crop": [x0, y0, x1, y1], same rule (integers = pixels, floats = fractions)
+inline CropWindow crop_from_json(const nlohmann::json& j) {
+    if (!j.is_array() || j.size() != 4) throw runtime_error("\"crop\" must be [x0, y0, x1, y1]");
+    CropWindow c;
+    c.normalized = any_of(j.begin(), j.end(), [](const nlohmann::json& v) { return v.is_number_float(); });
+    c.x0 = j[0]; c.y0 = j[1]; c.x1 = j[2]; c.y1 = j[3];
+    c.set = true;
+    return c;
+}
+
+#endif
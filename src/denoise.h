@@ -0,0 +1,144 @@
+// Description: Edge-avoiding à-trous denoiser (the spatial filter of SVGF). A 5x5 B-spline
+//              kernel is applied a few times with growing holes (1, 2, 4, ...). Every tap
+//              is weighted down by how much its first-hit normal, albedo and depth differ
+//              from the center pixel. It is also weighted down by its luminance difference,
+//              measured in standard deviations of the center's noise. That noise comes from
+//              the per-pixel sample variance and is filtered along with the color.
+//              Images are kept as separate float planes, so the inner loop over a row runs
+//              on SIMD lanes.
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include "vec3.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+using namespace std;
+
+struct DenoiseParams {
+    int iterations = 3;
+    float sigma_color  = 3.f;       // luminance difference, in standard deviations of the noise
+    float sigma_normal = 0.05f;     // length of the normal difference
+    float sigma_albedo = 0.2f;      // length of the albedo difference
+    float sigma_depth  = 0.02f;     // depth difference relative to the center depth, per tap step
+};
+
+// exp(-x) for x >= 0, a Taylor-based rational that is cheap to vectorize. Edge-stopping
+// weights only need a smooth falloff, not an exact exponential.
+inline float denoise_falloff(float x) {
+    return 1.f / (1.f + x * (1.f + x * (0.5f + x * (1.f / 6))));
+}
+
+// color, normal, albedo, depth (0 = no hit), variance of the mean luminance: width * height
+// each. An empty or all-zero variance (1 spp) falls back to the 3x3 spatial variance.
+inline void denoise(int width, int height, const vector<vec3>& color, const vector<vec3>& normal,
+                    const vector<vec3>& albedo, const vector<float>& depth, const vector<float>& variance,
+                    vector<vec3>& out, const DenoiseParams& p = DenoiseParams()) {
+    const size_t n = size_t(width) * height;
+    // Planes: 0-2 color, 3-5 normal, 6-8 albedo, 9 depth, 10 variance
+    vector<vector<float>> plane(11, vector<float>(n));
+    for (size_t i = 0; i < n; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            plane[c][i] = color[i][c];
+            plane[3 + c][i] = normal[i][c];
+            plane[6 + c][i] = albedo[i][c];
+        }
+        plane[9][i] = depth[i];
+    }
+
+    const bool has_variance = any_of(variance.begin(), variance.end(), [](float v) { return v > 0; });
+    if (has_variance) {
+        plane[10] = variance;
+    } else {
+        auto luminance = [&](size_t i) { return 0.2126f * plane[0][i] + 0.7152f * plane[1][i] + 0.0722f * plane[2][i]; };
+#pragma omp parallel for
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                float sum = 0, sum2 = 0;
+                int cnt = 0;
+                for (int yy = max(0, y - 1); yy <= min(height - 1, y + 1); ++yy) {
+                    for (int xx = max(0, x - 1); xx <= min(width - 1, x + 1); ++xx) {
+                        float l = luminance(size_t(yy) * width + xx);
+                        sum += l;
+                        sum2 += l * l;
+                        ++cnt;
+                    }
+                }
+                float mean = sum / cnt;
+                plane[10][size_t(y) * width + x] = max(0.f, sum2 / cnt - mean * mean);
+            }
+        }
+    }
+
+    const float kernel[3] = {3.f / 8, 1.f / 4, 1.f / 16};   // B3 spline, taps at 0, ±1, ±2
+    const float inv_sn = 1.f / (p.sigma_normal * p.sigma_normal);
+    const float inv_sa = 1.f / (p.sigma_albedo * p.sigma_albedo);
+    vector<float> next[4] = {vector<float>(n), vector<float>(n), vector<float>(n), vector<float>(n)};
+    vector<float> inv_sigma_l(n);
+
+    for (int it = 0, step = 1; it < p.iterations; ++it, step *= 2) {
+        const float* R = plane[0].data(); const float* G = plane[1].data(); const float* B = plane[2].data();
+        const float* NX = plane[3].data(); const float* NY = plane[4].data(); const float* NZ = plane[5].data();
+        const float* AX = plane[6].data(); const float* AY = plane[7].data(); const float* AZ = plane[8].data();
+        const float* Z = plane[9].data(); const float* V = plane[10].data();
+        float* outR = next[0].data(); float* outG = next[1].data(); float* outB = next[2].data();
+        float* outV = next[3].data();
+        float* ISL = inv_sigma_l.data();
+#pragma omp parallel for
+        for (int i = 0; i < int(n); ++i) ISL[i] = 1.f / (p.sigma_color * sqrt(V[i]) + 1e-4f);
+
+#pragma omp parallel
+{
+        vector<float> acc_r(width), acc_g(width), acc_b(width), acc_v(width), acc_w(width);
+        #pragma omp for schedule(dynamic, 4)
+        for (int y = 0; y < height; ++y) {
+            for (auto* acc : {&acc_r, &acc_g, &acc_b, &acc_v, &acc_w}) fill(acc->begin(), acc->end(), 0.f);
+            const size_t row = size_t(y) * width;
+            for (int ky = -2; ky <= 2; ++ky) {
+                const int yy = y + ky * step;
+                if (yy < 0 || yy >= height) continue;
+                for (int kx = -2; kx <= 2; ++kx) {
+                    const int dx = kx * step;
+                    const float h = kernel[abs(kx)] * kernel[abs(ky)];
+                    const float inv_sz = 1.f / (p.sigma_depth * float(step) * float(max(abs(kx), abs(ky))) + 1e-6f);
+                    const size_t qrow = size_t(yy) * width;
+                    const int x0 = max(0, -dx), x1 = min(width, width - dx);
+                    // Contiguous in x for the center and the tap: one SIMD loop per tap
+                    #pragma omp simd
+                    for (int x = x0; x < x1; ++x) {
+                        const size_t c = row + x, q = qrow + x + dx;
+                        float dnx = NX[c] - NX[q], dny = NY[c] - NY[q], dnz = NZ[c] - NZ[q];
+                        float dax = AX[c] - AX[q], day = AY[c] - AY[q], daz = AZ[c] - AZ[q];
+                        float lc = 0.2126f * R[c] + 0.7152f * G[c] + 0.0722f * B[c];
+                        float lq = 0.2126f * R[q] + 0.7152f * G[q] + 0.0722f * B[q];
+                        float e = (dnx * dnx + dny * dny + dnz * dnz) * inv_sn
+                                + (dax * dax + day * day + daz * daz) * inv_sa
+                                + fabsf(Z[c] - Z[q]) * inv_sz / (Z[c] + 1e-3f)
+                                + fabsf(lc - lq) * ISL[c];
+                        float w = h * denoise_falloff(e);
+                        acc_r[x] += w * R[q];
+                        acc_g[x] += w * G[q];
+                        acc_b[x] += w * B[q];
+                        acc_v[x] += w * w * V[q];
+                        acc_w[x] += w;
+                    }
+                }
+            }
+            for (int x = 0; x < width; ++x) {
+                float inv = 1.f / acc_w[x];         // the center tap always has weight h > 0
+                outR[row + x] = acc_r[x] * inv;
+                outG[row + x] = acc_g[x] * inv;
+                outB[row + x] = acc_b[x] * inv;
+                outV[row + x] = acc_v[x] * inv * inv;
+            }
+        }
+}
+        for (int c = 0; c < 3; ++c) swap(plane[c], next[c]);
+        swap(plane[10], next[3]);
+    }
+
+    out.resize(n);
+    for (size_t i = 0; i < n; ++i) out[i] = vec3{plane[0][i], plane[1][i], plane[2][i]};
+}
+
+#endif
@@ -0,0 +1,273 @@
+// Description: Distributed tile rendering. The coordinator splits the frame into tiles and
+//              hands them to render workers (the TCP render server, `--worker`) running on
+//              this host or on others. Tiles of a failed or timed-out worker go back to the
+//              queue, tiles of a straggler are duplicated on an idle worker (first reply
+//              wins), and whatever is left when every worker is gone is rendered locally.
+//              Every pixel is traced exactly as render() would, so the assembled image does
+//              not depend on how the tiles were distributed.
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#ifndef _WIN32
+
+#include "scene.h"
+#include "render.h"
+#include "net.h"
+#include "include/json.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <signal.h>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <vector>
+using namespace std;
+
+struct Tile {
+    int x0, y0, x1, y1;         // [x0, x1) x [y0, y1) of the frame
+};
+
+// Row-major tiles of at most size x size pixels
+inline vector<Tile> split_tiles(int width, int height, int size) {
+    vector<Tile> tiles;
+    for (int y = 0; y < height; y += size) {
+        for (int x = 0; x < width; x += size) {
+            tiles.push_back({x, y, min(x + size, width), min(y + size, height)});
+        }
+    }
+    return tiles;
+}
+
+struct DistributedOptions {
+    vector<string> workers;         // "host:port" of each worker
+    int tile_size = 64;
+    double tile_timeout = 120;      // seconds without a reply before a worker is dropped and its tile requeued
+    double straggler_factor = 4;    // duplicate a tile once it runs this many times longer than the average tile
+    int max_failures = 3;           // consecutive failures before a worker is given up
+};
+
+struct LocalWorker {
+    pid_t pid;
+    int port;
+};
+
+// Start n worker processes of 'exe' on 127.0.0.1. Each one inherits a socket that is already
+// listening, so the coordinator knows the ports up front and can connect right away.
+inline vector<LocalWorker> spawn_local_workers(const string& exe, int n) {
+    vector<LocalWorker> workers;
+    for (int i = 0; i < n; ++i) {
+        int fd = tcp_listen("127.0.0.1", 0);
+        if (fd < 0) {
+            cerr << "Cannot open a worker socket: " << strerror(errno) << "\n";
+            break;
+        }
+        int port = socket_port(fd);
+        pid_t pid = fork();
+        if (pid == 0) {
+            string fd_arg = to_string(fd);
+            execl(exe.c_str(), exe.c_str(), "--worker-fd", fd_arg.c_str(), static_cast<char*>(nullptr));
+            _exit(127);
+        }
+        close(fd);
+        if (pid < 0) {
+            cerr << "Cannot start a worker: " << strerror(errno) << "\n";
+            break;
+        }
+        workers.push_back({pid, port});
+    }
+    return workers;
+}
+
+inline void stop_local_workers(const vector<LocalWorker>& workers) {
+    for (const LocalWorker& w : workers) kill(w.pid, SIGTERM);
+    for (const LocalWorker& w : workers) waitpid(w.pid, nullptr, 0);
+}
+
+// Render 'scene' into framebuffer (width * height entries) on the given workers. Workers load
+// 'scene_path' themselves, so remote hosts need the scene (and its envmap) at the same path.
+inline void render_distributed(const string& scene_path, Scene& scene, const DistributedOptions& opt,
+                               vector<vec3>& framebuffer) {
+    using clock = chrono::steady_clock;
+    const vector<Tile> tiles = split_tiles(scene.width, scene.height, max(1, opt.tile_size));
+    const string abs_scene = filesystem::absolute(scene_path).lexically_normal().string();
+
+    struct WorkerStats {
+        string address;
+        int tiles = 0, failures = 0;
+        bool gave_up = false;
+    };
+
+    // Shared between the per-worker threads, guarded by m
+    mutex m;
+    condition_variable cv;
+    deque<int> pending;
+    vector<char> done(tiles.size(), 0);
+    vector<int> in_flight(tiles.size(), 0);
+    vector<clock::time_point> started(tiles.size());
+    size_t remaining = tiles.size();
+    double tile_ms_sum = 0;
+    int tile_ms_count = 0, duplicated = 0;
+    vector<WorkerStats> stats(opt.workers.size());
+    for (size_t t = 0; t < tiles.size(); ++t) pending.push_back(int(t));
+
+    // Next tile for an idle worker: a pending one, else a copy of the oldest straggler. -1 = none yet.
+    auto pick_tile = [&](clock::time_point now) {
+        if (!pending.empty()) {
+            int t = pending.front();
+            pending.pop_front();
+            if (in_flight[t]++ == 0) started[t] = now;
+            return t;
+        }
+        if (tile_ms_count == 0) return -1;
+        double limit_ms = opt.straggler_factor * tile_ms_sum / tile_ms_count;
+        int oldest = -1;
+        for (size_t t = 0; t < tiles.size(); ++t) {
+            if (done[t] || in_flight[t] != 1) continue;
+            if (chrono::duration<double, milli>(now - started[t]).count() < limit_ms) continue;
+            if (oldest < 0 || started[t] < started[oldest]) oldest = int(t);
+        }
+        if (oldest >= 0) {
+            ++in_flight[oldest];
+            ++duplicated;
+        }
+        return oldest;
+    };
+
+    auto worker_loop = [&](size_t w) {
+        WorkerStats& st = stats[w];
+        st.address = opt.workers[w];
+        string host;
+        int port;
+        if (!parse_host_port(st.address, host, port)) {
+            cerr << "Bad worker address " << st.address << "\n";
+            lock_guard<mutex> lock(m);
+            st.gave_up = true;
+            return;
+        }
+
+        int fd = -1;
+        unique_ptr<SocketReader> reader;
+        int consecutive_failures = 0;
+        vector<vec3> tile_pixels;
+        while (true) {
+            int t;
+            {
+                unique_lock<mutex> lock(m);
+                while (remaining > 0 && (t = pick_tile(clock::now())) < 0) {
+                    cv.wait_for(lock, chrono::milliseconds(50));
+                }
+                if (remaining == 0) break;
+            }
+
+            const Tile& tile = tiles[t];
+            const size_t count = size_t(tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+            auto t0 = clock::now();
+            string error;
+            if (fd < 0) {
+                fd = tcp_connect(host, port);
+                if (fd >= 0) {
+                    set_recv_timeout(fd, int(opt.tile_timeout * 1000));
+                    reader = make_unique<SocketReader>(fd);
+                } else {
+                    error = string("cannot connect: ") + strerror(errno);
+                }
+            }
+            if (fd >= 0) {
+                nlohmann::json job = {
+                    {"scene", abs_scene}, {"width", scene.width}, {"height", scene.height},
+                    {"spp", scene.spp}, {"depth", depthMax},
+                    {"tile", {tile.x0, tile.y0, tile.x1, tile.y1}}, {"format", "rgb32f"}
+                };
+                string line;
+                nlohmann::json reply;
+                if (!write_line(fd, job.dump()) || !reader->read_line(line)) {
+                    error = "no reply (timeout or connection lost)";
+                } else if (!(reply = nlohmann::json::parse(line, nullptr, false)).is_object()) {
+                    error = "malformed reply";
+                } else if (!reply.value("ok", false)) {
+                    error = reply.value("error", string("job failed"));
+                } else if (reply.value("bytes", size_t(0)) != count * sizeof(vec3)) {
+                    error = "unexpected tile size";
+                } else {
+                    tile_pixels.resize(count);
+                    if (!reader->read_exact(tile_pixels.data(), count * sizeof(vec3))) error = "truncated tile";
+                }
+            }
+
+            unique_lock<mutex> lock(m);
+            --in_flight[t];
+            if (error.empty()) {
+                consecutive_failures = 0;
+                ++st.tiles;
+                if (!done[t]) {     // a duplicate may have won already
+                    const int tile_w = tile.x1 - tile.x0;
+                    for (int y = tile.y0; y < tile.y1; ++y) {
+                        copy_n(tile_pixels.begin() + size_t(y - tile.y0) * tile_w, tile_w,
+                               framebuffer.begin() + size_t(y) * scene.width + tile.x0);
+                    }
+                    done[t] = 1;
+                    --remaining;
+                    tile_ms_sum += chrono::duration<double, milli>(clock::now() - t0).count();
+                    ++tile_ms_count;
+                }
+                cv.notify_all();
+                continue;
+            }
+
+            // Requeue the tile unless another worker still has it, drop the connection and retry later
+            if (!done[t] && in_flight[t] == 0) pending.push_front(t);
+            ++st.failures;
+            cerr << "Worker " << st.address << ": tile " << t << " failed: " << error << "\n";
+            cv.notify_all();
+            lock.unlock();
+            if (fd >= 0) close(fd);
+            fd = -1;
+            reader.reset();
+            if (++consecutive_failures >= opt.max_failures) {
+                lock_guard<mutex> relock(m);
+                st.gave_up = true;
+                break;
+            }
+            this_thread::sleep_for(chrono::milliseconds(200 * consecutive_failures));
+        }
+        if (fd >= 0) close(fd);
+    };
+
+    vector<thread> threads;
+    for (size_t w = 0; w < opt.workers.size(); ++w) threads.emplace_back(worker_loop, w);
+    for (thread& th : threads) th.join();
+
+    // Nobody left to take the remaining tiles
+    int local_tiles = 0;
+    for (size_t t = 0; t < tiles.size(); ++t) {
+        if (done[t]) continue;
+        if (local_tiles++ == 0) {
+            cerr << "No worker left, rendering the remaining tiles locally\n";
+            if (scene.bvh.empty()) prepare_bvh(scene, "cache");
+        }
+        const Tile& tile = tiles[t];
+        vector<vec3> tile_pixels;
+        render_tile(scene, tile.x0, tile.y0, tile.x1, tile.y1, tile_pixels);
+        const int tile_w = tile.x1 - tile.x0;
+        for (int y = tile.y0; y < tile.y1; ++y) {
+            copy_n(tile_pixels.begin() + size_t(y - tile.y0) * tile_w, tile_w,
+                   framebuffer.begin() + size_t(y) * scene.width + tile.x0);
+        }
+    }
+
+    printf("%-24s %8s %9s  %s\n", "worker", "tiles", "failures", "status");
+    for (const WorkerStats& st : stats) {
+        printf("%-24s %8d %9d  %s\n", st.address.c_str(), st.tiles, st.failures, st.gave_up ? "gave up" : "ok");
+    }
+    printf("%zu tiles, %d duplicated for stragglers, %d rendered locally\n", tiles.size(), duplicated, local_tiles);
+}
+
+#endif // _WIN32
+
+#endif
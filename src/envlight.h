@@ -0,0 +1,122 @@
+// Description: Importance sampling of the equirectangular envmap for image-based lighting.
+//              The map is averaged down to a coarse grid of cells. Each cell is weighted by
+//              its luminance times sin(theta), the solid angle it covers. A marginal CDF over
+//              the rows and one conditional CDF per row pick a cell with probability
+//              proportional to the light it sends, and a direction is placed inside that cell.
+#ifndef ENVLIGHT_H
+#define ENVLIGHT_H
+
+#include "vec3.h"
+#include "background.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+using namespace std;
+
+struct EnvDistribution {
+    int width = 0, height = 0;      // grid cells
+    vector<float> conditional;      // height rows of width + 1 CDF entries
+    vector<float> marginal;         // height + 1 CDF entries over the rows
+    vector<float> cell_pdf;         // probability of each cell * cell count (1 = uniform)
+};
+
+// Inverse of Background::direction_to_uv
+inline vec3 env_direction(float u, float v) {
+    float phi = (u - 0.25f) * 2.f * float(M_PI) - float(M_PI);
+    float theta = v * float(M_PI);
+    float sin_t = sin(theta);
+    return vec3{sin_t * cos(phi), cos(theta), -sin_t * sin(phi)};
+}
+
+// Grid of at most max_width x max_width / 2 cells over the envmap of bg. A tiled envmap is
+// read from its first mip level that is at most max_width wide.
+inline shared_ptr<const EnvDistribution> build_env_distribution(const Background& bg, int max_width = 1024) {
+    if (!bg.has_image() || bg.width <= 0 || bg.height <= 0) return nullptr;
+    int level = 0, sw = bg.width, sh = bg.height;
+    if (bg.tiled) {
+        while (level + 1 < bg.tiled->num_levels() && bg.tiled->level_width(level) > max_width) ++level;
+        sw = bg.tiled->level_width(level);
+        sh = bg.tiled->level_height(level);
+    }
+    auto texel = [&](int x, int y) {
+        return bg.tiled ? bg.tiled->texel(level, x, y) : bg.image_data + (size_t(y) * sw + x) * 3;
+    };
+
+    auto dist = make_shared<EnvDistribution>();
+    const int W = min(sw, max_width), H = min(sh, max(1, max_width / 2));
+    dist->width = W;
+    dist->height = H;
+    dist->conditional.assign(size_t(W + 1) * H, 0.f);
+    dist->marginal.assign(H + 1, 0.f);
+    dist->cell_pdf.assign(size_t(W) * H, 0.f);
+
+    // Average luminance of the texels in each cell, weighted by the cell's solid angle
+#pragma omp parallel for
+    for (int cy = 0; cy < H; ++cy) {
+        int y0 = int(int64_t(cy) * sh / H), y1 = max(y0 + 1, int(int64_t(cy + 1) * sh / H));
+        float sin_t = sin((cy + 0.5f) / H * float(M_PI));
+        for (int cx = 0; cx < W; ++cx) {
+            int x0 = int(int64_t(cx) * sw / W), x1 = max(x0 + 1, int(int64_t(cx + 1) * sw / W));
+            double sum = 0;
+            for (int y = y0; y < y1; ++y) {
+                for (int x = x0; x < x1; ++x) {
+                    const unsigned char* p = texel(x, y);
+                    sum += 0.2126 * p[0] + 0.7152 * p[1] + 0.0722 * p[2];
+                }
+            }
+            dist->cell_pdf[size_t(cy) * W + cx] = float(sum / (double(y1 - y0) * (x1 - x0) * 255.0)) * sin_t;
+        }
+    }
+
+    for (int cy = 0; cy < H; ++cy) {
+        float* cdf = &dist->conditional[size_t(cy) * (W + 1)];
+        for (int cx = 0; cx < W; ++cx) cdf[cx + 1] = cdf[cx] + dist->cell_pdf[size_t(cy) * W + cx];
+        dist->marginal[cy + 1] = dist->marginal[cy] + cdf[W];
+    }
+    const float total = dist->marginal[H];
+    if (total <= 0) return nullptr;                         // black map: nothing to sample
+    for (int cy = 0; cy < H; ++cy) {
+        float* cdf = &dist->conditional[size_t(cy) * (W + 1)];
+        float row = cdf[W];
+        for (int cx = 1; cx <= W; ++cx) cdf[cx] = row > 0 ? cdf[cx] / row : float(cx) / W;
+        dist->marginal[cy + 1] /= total;
+    }
+    for (float& p : dist->cell_pdf) p *= float(W) * H / total;
+    return dist;
+}
+
+// Index i with cdf[i] <= u < cdf[i + 1], skipping empty entries
+inline int env_cdf_find(const float* cdf, int n, float u) {
+    int i = int(upper_bound(cdf + 1, cdf + n + 1, u) - (cdf + 1));
+    return min(i, n - 1);
+}
+
+// Solid angle pdf of direction d
+inline float env_pdf(const EnvDistribution& dist, const vec3& d) {
+    float u, v;
+    Background::direction_to_uv(d, u, v);
+    float sin_t = sqrt(max(0.f, 1.f - d.y * d.y));
+    if (sin_t <= 0) return 0;
+    int cx = min(int(u * dist.width), dist.width - 1), cy = min(int(v * dist.height), dist.height - 1);
+    return dist.cell_pdf[size_t(cy) * dist.width + cx] / (2.f * float(M_PI) * float(M_PI) * sin_t);
+}
+
+// Direction for (u1, u2) in [0, 1)^2 and its solid angle pdf
+inline vec3 env_sample(const EnvDistribution& dist, float u1, float u2, float& pdf) {
+    const int W = dist.width, H = dist.height;
+    int cy = env_cdf_find(dist.marginal.data(), H, u1);
+    float m0 = dist.marginal[cy], m1 = dist.marginal[cy + 1];
+    float fy = m1 > m0 ? (u1 - m0) / (m1 - m0) : 0.5f;
+    const float* cdf = &dist.conditional[size_t(cy) * (W + 1)];
+    int cx = env_cdf_find(cdf, W, u2);
+    float c0 = cdf[cx], c1 = cdf[cx + 1];
+    float fx = c1 > c0 ? (u2 - c0) / (c1 - c0) : 0.5f;
+
+    vec3 d = env_direction((cx + fx) / W, (cy + fy) / H);
+    float sin_t = sqrt(max(0.f, 1.f - d.y * d.y));
+    pdf = sin_t > 0 ? dist.cell_pdf[size_t(cy) * W + cx] / (2.f * float(M_PI) * float(M_PI) * sin_t) : 0.f;
+    return d;
+}
+
+#endif
@@ -0,0 +1,139 @@
+// Description: Compact framebuffer storage for very large frames. Pixels can be kept as
+//              32-bit floats (12 bytes), half floats (6 bytes) or shared-exponent RGB9E5
+//              (4 bytes, positive values only, ~9 bits of mantissa per channel).
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "vec3.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+
+enum class FramebufferFormat { Float, Half, RGB9E5 };
+
+inline FramebufferFormat framebuffer_format_by_name(const string& name) {
+    if (name == "float") return FramebufferFormat::Float;
+    if (name == "half") return FramebufferFormat::Half;
+    if (name == "rgb9e5") return FramebufferFormat::RGB9E5;
+    throw runtime_error("unknown framebuffer format " + name + " (float, half or rgb9e5)");
+}
+
+// IEEE 754 binary16, round to nearest even. Overflow gives inf, NaN stays NaN.
+inline uint16_t float_to_half(float f) {
+    uint32_t x;
+    memcpy(&x, &f, 4);
+    uint32_t sign = (x >> 16) & 0x8000u;
+    uint32_t abs = x & 0x7fffffffu;
+    if (abs >= 0x7f800000u) return uint16_t(sign | 0x7c00u | (abs > 0x7f800000u ? 0x200u : 0));
+    if (abs >= 0x477ff000u) return uint16_t(sign | 0x7c00u);        // rounds to >= 65520: inf
+    if (abs < 0x38800000u) {                                        // half subnormal or zero
+        if (abs < 0x33000000u) return uint16_t(sign);
+        uint32_t mant = (abs & 0x7fffffu) | 0x800000u;
+        int shift = 126 - int(abs >> 23);                           // 14..24
+        uint32_t half = mant >> shift;
+        uint32_t rest = mant & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) ++half;
+        return uint16_t(sign | half);
+    }
+    uint32_t h = ((abs - 0x38000000u) >> 13);                       // rebias exponent 127 -> 15
+    uint32_t rest = abs & 0x1fffu;
+    if (rest > 0x1000u || (rest == 0x1000u && (h & 1))) ++h;
+    return uint16_t(sign | h);
+}
+
+inline float half_to_float(uint16_t h) {
+    uint32_t sign = uint32_t(h & 0x8000u) << 16;
+    uint32_t exp = (h >> 10) & 0x1fu, mant = h & 0x3ffu;
+    uint32_t x;
+    if (exp == 0x1f) x = sign | 0x7f800000u | (mant << 13);
+    else if (exp != 0) x = sign | ((exp + 112) << 23) | (mant << 13);
+    else if (mant == 0) x = sign;
+    else {                                                          // subnormal: normalize
+        int e = -1;
+        do { mant <<= 1; ++e; } while (!(mant & 0x400u));
+        x = sign | (uint32_t(112 - e) << 23) | ((mant & 0x3ffu) << 13);
+    }
+    float f;
+    memcpy(&f, &x, 4);
+    return f;
+}
+
+// Shared exponent RGB9E5 (as in EXT_texture_shared_exponent): 9-bit mantissas, 5-bit exponent
+inline uint32_t float3_to_rgb9e5(const vec3& c) {
+    constexpr int N = 9, B = 15;
+    constexpr float max_value = float((1 << N) - 1) / (1 << N) * 65536.f;
+    auto clamp_c = [&](float v) { return v > 0 ? min(v, max_value) : 0.f; };    // also maps NaN to 0
+    float r = clamp_c(c.x), g = clamp_c(c.y), b = clamp_c(c.z);
+    float max_c = max(r, max(g, b));
+    int exp_shared = max(-B - 1, int(floor(log2(max(max_c, 1e-30f))))) + 1 + B;
+    float scale = exp2(float(exp_shared - B - N));
+    if (int(floor(max_c / scale + 0.5f)) == (1 << N)) {
+        ++exp_shared;
+        scale *= 2;
+    }
+    uint32_t rm = uint32_t(floor(r / scale + 0.5f)), gm = uint32_t(floor(g / scale + 0.5f)),
+             bm = uint32_t(floor(b / scale + 0.5f));
+    return rm | (gm << 9) | (bm << 18) | (uint32_t(exp_shared) << 27);
+}
+
+inline vec3 rgb9e5_to_float3(uint32_t v) {
+    float scale = exp2(float(int(v >> 27) - 15 - 9));
+    return vec3{float(v & 0x1ffu) * scale, float((v >> 9) & 0x1ffu) * scale, float((v >> 18) & 0x1ffu) * scale};
+}
+
+// width * height pixels in one of the formats above
+class PackedFramebuffer {
+public:
+    PackedFramebuffer(int width, int height, FramebufferFormat format)
+        : width_(width), height_(height), format_(format) {
+        size_t n = size_t(width) * height;
+        if (format == FramebufferFormat::Float) f32_.resize(n);
+        else if (format == FramebufferFormat::Half) f16_.resize(n * 3);
+        else e5_.resize(n);
+    }
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    FramebufferFormat format() const { return format_; }
+    size_t bytes() const { return f32_.size() * sizeof(vec3) + f16_.size() * 2 + e5_.size() * 4; }
+
+    // Pixels [first, first + count) in row-major order
+    void store(size_t first, const vec3* src, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            const vec3& c = src[i];
+            size_t p = first + i;
+            if (format_ == FramebufferFormat::Float) f32_[p] = c;
+            else if (format_ == FramebufferFormat::Half) {
+                f16_[p * 3] = float_to_half(c.x);
+                f16_[p * 3 + 1] = float_to_half(c.y);
+                f16_[p * 3 + 2] = float_to_half(c.z);
+            }
+            else e5_[p] = float3_to_rgb9e5(c);
+        }
+    }
+
+    void load(size_t first, vec3* dst, size_t count) const {
+        for (size_t i = 0; i < count; ++i) {
+            size_t p = first + i;
+            if (format_ == FramebufferFormat::Float) dst[i] = f32_[p];
+            else if (format_ == FramebufferFormat::Half) {
+                dst[i] = vec3{half_to_float(f16_[p * 3]), half_to_float(f16_[p * 3 + 1]), half_to_float(f16_[p * 3 + 2])};
+            }
+            else dst[i] = rgb9e5_to_float3(e5_[p]);
+        }
+    }
+
+private:
+    int width_, height_;
+    FramebufferFormat format_;
+    vector<vec3> f32_;
+    vector<uint16_t> f16_;
+    vector<uint32_t> e5_;
+};
+
+#endif
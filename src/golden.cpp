@@ -0,0 +1,185 @@
+// Golden-image regression check: renders a fixed set of small reference scenes
+// (seeded, so DOF noise is reproducible) and compares them against stored golden
+// images with a per-pixel and PSNR tolerance. Failing scenes get a diff image.
+//
+// Build: g++ -std=c++17 -fopenmp -O2 -o golden src/golden.cpp
+// Usage: ./golden                          compare the current build against golden/*.png
+//        ./golden --update                 rewrite them after an intended change of the output
+//        ./golden --compare a.png b.png    compare any two images
+// Options: --dir golden  --tol 2  --max-bad 0.001  --psnr 40
+#include <iostream>
+#include <vector>
+#include <string>
+#include <filesystem>
+#include <functional>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "include/stb_image_write.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "include/stb_image.h"
+
+#include "scene.h"
+#include "scenegen.h"
+#include "render.h"
+#include "image.h"
+#include "imgcompare.h"
+
+using namespace std;
+
+int depthMax;
+
+struct ReferenceScene {
+    string name;
+    SceneGenParams params;
+    int depth;
+    bool envmap;    // use assets/envmap.jpg as background (run from the project root)
+    function<void(Scene&)> setup;   // renderer features on top of the generated scene
+};
+
+static vector<ReferenceScene> reference_scenes() {
+    auto make = [](const string& name, int spheres, int lights, const string& mix, bool dof,
+                   int depth, bool envmap, uint32_t seed, function<void(Scene&)> setup = nullptr) {
+        ReferenceScene r;
+        r.name = name;
+        r.params.num_spheres = spheres;
+        r.params.num_lights  = lights;
+        r.params.mix         = mix;
+        r.params.dof         = dof;
+        r.params.width       = 160;
+        r.params.height      = 120;
+        r.params.seed        = seed;
+        r.depth  = depth;
+        r.envmap = envmap;
+        r.setup  = setup;
+        return r;
+    };
+    return {
+        make("basic",  12,  2, "mixed",   false, 4, false, 1),
+        make("glass",  12,  2, "glass",   false, 6, false, 2),
+        make("dof",    12,  3, "mixed",   true,  3, false, 3),
+        make("dense",  300, 1, "diffuse", false, 2, false, 4),
+        make("envmap", 12,  2, "mixed",   false, 4, true,  5),
+        make("sobol",  12,  3, "mixed",   true,  3, false, 6, [](Scene& s) {
+            s.spp = 8; s.sampler = SamplerType::Sobol; s.jitter = true;
+        }),
+        make("stratified", 12, 2, "mixed", false, 4, false, 7, [](Scene& s) {
+            s.spp = 4; s.sampler = SamplerType::Stratified; s.jitter = true;
+        }),
+        make("ibl",    12,  1, "diffuse", false, 3, true,  8, [](Scene& s) {
+            s.spp = 4; s.bg.ibl_samples = 4;
+        }),
+        make("cone",   12,  2, "glass",   false, 4, true,  9, [](Scene& s) {
+            s.bg.filter = EnvFilter::Cone;
+        }),
+        make("fresnel", 12, 2, "glass",   false, 5, false, 10, [](Scene& s) {
+            s.fresnel = FresnelModel::Exact; s.fresnel_split = false;
+        }),
+        make("fresnel_split", 12, 2, "glass", false, 5, false, 11, [](Scene& s) {
+            s.spp = 8; s.fresnel = FresnelModel::Schlick;
+        }),
+    };
+}
+
+static bool load_rgb8(const string& path, int& w, int& h, vector<unsigned char>& out) {
+    int channels;
+    unsigned char* data = stbi_load(path.c_str(), &w, &h, &channels, 3);
+    if (!data) return false;
+    out.assign(data, data + size_t(w) * h * 3);
+    stbi_image_free(data);
+    return true;
+}
+
+static void report(const string& name, const ImageDiff& d) {
+    printf("%-10s %-4s  psnr %7.2f dB  max diff %3d  bad pixels %zu\n",
+           name.c_str(), d.passed ? "ok" : "FAIL", d.psnr, d.max_diff, d.bad_pixels);
+}
+
+int main(int argc, char* argv[]) {
+    string dir = "golden";
+    bool update = false;
+    ImageTolerance tol;
+    vector<string> compare_paths;
+
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        auto value = [&]() -> string {
+            if (i + 1 >= argc) { cerr << "Missing value for " << a << "\n"; exit(2); }
+            return argv[++i];
+        };
+        if      (a == "--update")  update = true;
+        else if (a == "--dir")     dir = value();
+        else if (a == "--tol")     tol.pixel_tol = stoi(value());
+        else if (a == "--max-bad") tol.max_bad_ratio = stof(value());
+        else if (a == "--psnr")    tol.min_psnr = stof(value());
+        else if (a == "--compare") { compare_paths.push_back(value()); compare_paths.push_back(value()); }
+        else { cerr << "Unknown option " << a << "\n"; return 2; }
+    }
+
+    // Plain two-image comparison, diff goes next to the second image
+    if (!compare_paths.empty()) {
+        int w0, h0, w1, h1;
+        vector<unsigned char> a, b;
+        if (!load_rgb8(compare_paths[0], w0, h0, a) || !load_rgb8(compare_paths[1], w1, h1, b)) {
+            cerr << "Failed to load images\n";
+            return 2;
+        }
+        if (w0 != w1 || h0 != h1) {
+            cerr << "Size mismatch: " << w0 << "x" << h0 << " vs " << w1 << "x" << h1 << "\n";
+            return 1;
+        }
+        ImageDiff d = compare_rgb8(a, b, tol);
+        report(filesystem::path(compare_paths[1]).filename().string(), d);
+        if (!d.passed) {
+            string diff_path = compare_paths[1] + ".diff.png";
+            vector<unsigned char> diff = diff_image_rgb8(a, b, tol);
+            stbi_write_png(diff_path.c_str(), w0, h0, 3, diff.data(), w0 * 3);
+            cout << "Diff written to " << diff_path << endl;
+        }
+        return d.passed ? 0 : 1;
+    }
+
+    filesystem::create_directories(dir);
+    int failures = 0;
+    for (const ReferenceScene& ref : reference_scenes()) {
+        Scene scene = generate_scene(ref.params);
+        if (ref.setup) ref.setup(scene);
+        prepare_bvh(scene, "");
+        if (ref.envmap && !load_envmap(scene.bg, "assets/envmap.jpg")) {     // also builds the IBL distribution
+            cerr << ref.name << ": assets/envmap.jpg not found, run from the project root\n";
+            ++failures;
+            continue;
+        }
+        depthMax = ref.depth;
+
+        vector<vec3> framebuffer(scene.width * scene.height);
+        render(scene, framebuffer);
+        vector<unsigned char> img = framebuffer_to_rgb8(framebuffer);
+        if (scene.bg.image_data) stbi_image_free(scene.bg.image_data);
+
+        string golden_path = dir + "/" + ref.name + ".png";
+        if (update) {
+            stbi_write_png(golden_path.c_str(), scene.width, scene.height, 3, img.data(), scene.width * 3);
+            cout << "Updated " << golden_path << endl;
+            continue;
+        }
+
+        int w, h;
+        vector<unsigned char> golden;
+        if (!load_rgb8(golden_path, w, h, golden) || w != scene.width || h != scene.height) {
+            cerr << ref.name << ": missing or mismatched " << golden_path << " (run with --update first)\n";
+            ++failures;
+            continue;
+        }
+        ImageDiff d = compare_rgb8(golden, img, tol);
+        report(ref.name, d);
+        if (!d.passed) {
+            ++failures;
+            string base = dir + "/" + ref.name;
+            vector<unsigned char> diff = diff_image_rgb8(golden, img, tol);
+            stbi_write_png((base + ".diff.png").c_str(), w, h, 3, diff.data(), w * 3);
+            stbi_write_png((base + ".new.png").c_str(), w, h, 3, img.data(), w * 3);
+        }
+    }
+    if (!update) cout << (failures ? to_string(failures) + " scene(s) failed" : "all scenes passed") << endl;
+    return failures ? 1 : 0;
+}
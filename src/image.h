@@ -0,0 +1,141 @@
+// Description: Framebuffer output. Converts the float framebuffer to 8-bit RGB
+//              and writes it as .ppm or .png (via stb_image_write), or keeps the
+//              floats as .pfm for HDR work (see tonemap.cpp).
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "vec3.h"
+#ifndef INCLUDE_STB_IMAGE_WRITE_H  // the .cpp may already have pulled in the implementation
+#include "include/stb_image_write.h"
+#endif
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Scale down colors brighter than 1 (keep hue), then quantize to 8 bits
+inline void to_rgb8(const vec3& color, unsigned char* out) {
+    float max_c = max(1.f, max(color[0], max(color[1], color[2])));
+    for (int i = 0; i < 3; ++i) {
+        out[i] = static_cast<unsigned char>(255 * color[i] / max_c);
+    }
+}
+
+// Whole framebuffer to a packed RGB8 buffer (width * height * 3 bytes)
+inline vector<unsigned char> framebuffer_to_rgb8(const vector<vec3>& framebuffer) {
+    vector<unsigned char> img_data(framebuffer.size() * 3);
+    for (size_t i = 0; i < framebuffer.size(); ++i) {
+        to_rgb8(framebuffer[i], &img_data[i * 3]);
+    }
+    return img_data;
+}
+
+// Binary PPM (P6) to any stream
+inline void write_ppm(ostream& os, int width, int height, const vector<vec3>& framebuffer) {
+    os << "P6\n" << width << " " << height << "\n255\n";
+    vector<unsigned char> img_data = framebuffer_to_rgb8(framebuffer);
+    os.write(reinterpret_cast<const char*>(img_data.data()), img_data.size());
+}
+
+inline bool save_ppm(const string& path, int width, int height, const vector<vec3>& framebuffer) {
+    ofstream ofs(path, ios::binary);
+    write_ppm(ofs, width, height, framebuffer);
+    return bool(ofs);
+}
+
+// Already quantized RGB8 pixels (e.g. a crop merged into a loaded image)
+inline bool save_ppm_rgb8(const string& path, int width, int height, const vector<unsigned char>& rgb) {
+    ofstream ofs(path, ios::binary);
+    ofs << "P6\n" << width << " " << height << "\n255\n";
+    ofs.write(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+    return bool(ofs);
+}
+
+inline bool save_png_rgb8(const string& path, int width, int height, const vector<unsigned char>& rgb) {
+    return stbi_write_png(path.c_str(), width, height, 3, rgb.data(), width * 3) != 0;
+}
+
+inline bool save_png(const string& path, int width, int height, const vector<vec3>& framebuffer) {
+    vector<unsigned char> img_data = framebuffer_to_rgb8(framebuffer);
+    return stbi_write_png(path.c_str(), width, height, 3, img_data.data(), width * 3) != 0;
+}
+
+// Portable float map (PF): 3 floats per pixel in host byte order, rows stored bottom to top.
+// A negative scale in the header marks little-endian data.
+inline bool host_is_little_endian() {
+    const uint16_t probe = 1;
+    unsigned char first;
+    memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+inline void write_pfm(ostream& os, int width, int height, const vector<vec3>& framebuffer) {
+    os << "PF\n" << width << " " << height << "\n" << (host_is_little_endian() ? "-1.0" : "1.0") << "\n";
+    for (int y = height - 1; y >= 0; --y) {
+        os.write(reinterpret_cast<const char*>(&framebuffer[size_t(y) * width]), streamsize(width * sizeof(vec3)));
+    }
+}
+
+inline bool save_pfm(const string& path, int width, int height, const vector<vec3>& framebuffer) {
+    ofstream ofs(path, ios::binary);
+    write_pfm(ofs, width, height, framebuffer);
+    return bool(ofs);
+}
+
+// Reads color (PF) and grayscale (Pf) maps of either byte order into top-to-bottom rows
+inline bool load_pfm(const string& path, int& width, int& height, vector<vec3>& framebuffer) {
+    ifstream ifs(path, ios::binary);
+    string magic;
+    float scale;
+    if (!(ifs >> magic >> width >> height >> scale) || (magic != "PF" && magic != "Pf") ||
+        width <= 0 || height <= 0 || int64_t(width) * height > (1LL << 30)) {
+        return false;
+    }
+    ifs.get();                          // single whitespace before the data
+    const int channels = magic == "PF" ? 3 : 1;
+    const bool swap = (scale < 0) != host_is_little_endian();
+    vector<float> row(size_t(width) * channels);
+    framebuffer.resize(size_t(width) * height);
+    for (int y = height - 1; y >= 0; --y) {
+        if (!ifs.read(reinterpret_cast<char*>(row.data()), streamsize(row.size() * sizeof(float)))) return false;
+        if (swap) {
+            for (float& v : row) {
+                uint32_t bits;
+                memcpy(&bits, &v, 4);
+                bits = (bits >> 24) | ((bits >> 8) & 0xff00u) | ((bits << 8) & 0xff0000u) | (bits << 24);
+                memcpy(&v, &bits, 4);
+            }
+        }
+        for (int x = 0; x < width; ++x) {
+            const float* p = &row[size_t(x) * channels];
+            framebuffer[size_t(y) * width + x] = channels == 3 ? vec3{p[0], p[1], p[2]} : vec3{p[0], p[0], p[0]};
+        }
+    }
+    return true;
+}
+
+// Encoded images in memory (for sending over a socket)
+inline vector<unsigned char> encode_png(int width, int height, const vector<vec3>& framebuffer) {
+    vector<unsigned char> img_data = framebuffer_to_rgb8(framebuffer);
+    vector<unsigned char> out;
+    stbi_write_png_to_func([](void* ctx, void* data, int size) {
+        auto* bytes = static_cast<vector<unsigned char>*>(ctx);
+        bytes->insert(bytes->end(), static_cast<unsigned char*>(data), static_cast<unsigned char*>(data) + size);
+    }, &out, width, height, 3, img_data.data(), width * 3);
+    return out;
+}
+
+inline vector<unsigned char> encode_ppm(int width, int height, const vector<vec3>& framebuffer) {
+    string header = "P6\n" + to_string(width) + " " + to_string(height) + "\n255\n";
+    vector<unsigned char> out(header.begin(), header.end());
+    vector<unsigned char> img_data = framebuffer_to_rgb8(framebuffer);
+    out.insert(out.end(), img_data.begin(), img_data.end());
+    return out;
+}
+
+#endif
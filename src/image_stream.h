@@ -0,0 +1,141 @@
+// Description: Row-streaming image writers. Rows are handed over top to bottom as soon as a
+//              strip of the frame is finished, so the full frame never has to be resident.
+//              PPM and PFM are raw rows. PNG is written with stored (uncompressed) deflate
+//              blocks, one IDAT chunk per strip, since stb_image_write needs the full image.
+#ifndef IMAGE_STREAM_H
+#define IMAGE_STREAM_H
+
+#include "vec3.h"
+#include "image.h"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+class ImageStreamWriter {
+public:
+    enum class Kind { PPM, PFM, PNG };
+
+    bool open(const string& path, Kind kind, int width, int height) {
+        kind_ = kind;
+        width_ = width;
+        height_ = height;
+        rows_written_ = 0;
+        out_.open(path, ios::binary);
+        if (kind == Kind::PPM) out_ << "P6\n" << width << " " << height << "\n255\n";
+        else if (kind == Kind::PFM) {
+            out_ << "PF\n" << width << " " << height << "\n" << (host_is_little_endian() ? "-1.0" : "1.0") << "\n";
+            pfm_data_start_ = out_.tellp();
+        }
+        else start_png();
+        return bool(out_);
+    }
+
+    // 'count' full rows, continuing where the last call stopped
+    bool write_rows(const vec3* rows, int count) {
+        if (kind_ == Kind::PFM) {
+            // PFM stores rows bottom to top: seek to each row's final place
+            for (int r = 0; r < count; ++r) {
+                int y = rows_written_ + r;
+                out_.seekp(pfm_data_start_ + streamoff(height_ - 1 - y) * width_ * streamoff(sizeof(vec3)));
+                out_.write(reinterpret_cast<const char*>(rows + size_t(r) * width_), streamsize(width_ * sizeof(vec3)));
+            }
+        } else {
+            vector<unsigned char> rgb(size_t(width_) * 3 * count + (kind_ == Kind::PNG ? count : 0));
+            unsigned char* p = rgb.data();
+            for (int r = 0; r < count; ++r) {
+                if (kind_ == Kind::PNG) *p++ = 0;                   // filter type: none
+                for (int x = 0; x < width_; ++x, p += 3) to_rgb8(rows[size_t(r) * width_ + x], p);
+            }
+            if (kind_ == Kind::PPM) out_.write(reinterpret_cast<const char*>(rgb.data()), streamsize(rgb.size()));
+            else png_idat(rgb, rows_written_ + count == height_);
+        }
+        rows_written_ += count;
+        return bool(out_);
+    }
+
+    bool close() {
+        if (kind_ == Kind::PNG) png_chunk("IEND", {});
+        out_.close();
+        return rows_written_ == height_ && !out_.fail();
+    }
+
+private:
+    Kind kind_ = Kind::PPM;
+    int width_ = 0, height_ = 0, rows_written_ = 0;
+    ofstream out_;
+    streampos pfm_data_start_ = 0;
+    uint32_t adler_a_ = 1, adler_b_ = 0;
+
+    static uint32_t crc32(const unsigned char* data, size_t n, uint32_t crc = 0) {
+        static const vector<uint32_t> table = [] {
+            vector<uint32_t> t(256);
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                t[i] = c;
+            }
+            return t;
+        }();
+        crc = ~crc;
+        for (size_t i = 0; i < n; ++i) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    static void put_be32(vector<unsigned char>& v, uint32_t x) {
+        v.insert(v.end(), {uint8_t(x >> 24), uint8_t(x >> 16), uint8_t(x >> 8), uint8_t(x)});
+    }
+
+    void png_chunk(const char* type, const vector<unsigned char>& data) {
+        vector<unsigned char> buf;
+        put_be32(buf, uint32_t(data.size()));
+        buf.insert(buf.end(), type, type + 4);
+        buf.insert(buf.end(), data.begin(), data.end());
+        uint32_t crc = crc32(buf.data() + 4, buf.size() - 4);
+        put_be32(buf, crc);
+        out_.write(reinterpret_cast<const char*>(buf.data()), streamsize(buf.size()));
+    }
+
+    void start_png() {
+        static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        out_.write(reinterpret_cast<const char*>(signature), 8);
+        vector<unsigned char> ihdr;
+        put_be32(ihdr, uint32_t(width_));
+        put_be32(ihdr, uint32_t(height_));
+        ihdr.insert(ihdr.end(), {8, 2, 0, 0, 0});                   // 8-bit RGB, no interlace
+        png_chunk("IHDR", ihdr);
+        adler_a_ = 1;
+        adler_b_ = 0;
+    }
+
+    // Scanlines as stored deflate blocks (max 65535 bytes each), zlib header in the first
+    // chunk and the Adler-32 of all scanlines after the final block.
+    void png_idat(const vector<unsigned char>& raw, bool last) {
+        vector<unsigned char> data;
+        if (rows_written_ == 0) data.insert(data.end(), {0x78, 0x01});
+        size_t pos = 0;
+        do {
+            size_t len = min<size_t>(65535, raw.size() - pos);
+            bool final_block = last && pos + len == raw.size();
+            data.push_back(final_block ? 1 : 0);
+            data.insert(data.end(), {uint8_t(len), uint8_t(len >> 8), uint8_t(~len), uint8_t(~len >> 8)});
+            data.insert(data.end(), raw.begin() + pos, raw.begin() + pos + len);
+            pos += len;
+        } while (pos < raw.size());
+        for (size_t i = 0; i < raw.size();) {
+            size_t end = min(raw.size(), i + 5552);                 // no uint32 overflow before the modulo
+            for (; i < end; ++i) {
+                adler_a_ += raw[i];
+                adler_b_ += adler_a_;
+            }
+            adler_a_ %= 65521;
+            adler_b_ %= 65521;
+        }
+        if (last) put_be32(data, (adler_b_ << 16) | adler_a_);
+        png_chunk("IDAT", data);
+    }
+};
+
+#endif
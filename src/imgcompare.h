@@ -0,0 +1,70 @@
+// Description: Compare two 8-bit RGB images with a per-pixel and PSNR tolerance,
+//              and build a diff image that highlights where they differ.
+#ifndef IMGCOMPARE_H
+#define IMGCOMPARE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+using namespace std;
+
+struct ImageTolerance {
+    int   pixel_tol     = 2;       // max abs difference per channel (0..255) before a pixel counts as bad
+    float max_bad_ratio = 0.001f;  // allowed fraction of bad pixels
+    float min_psnr      = 40.f;    // dB, over all channels
+};
+
+struct ImageDiff {
+    size_t bad_pixels = 0;
+    int    max_diff   = 0;
+    double psnr       = numeric_limits<double>::infinity(); // identical images -> inf
+    bool   passed     = true;
+};
+
+// a and b are packed RGB8 buffers of the same size (width * height * 3)
+inline ImageDiff compare_rgb8(const vector<unsigned char>& a, const vector<unsigned char>& b,
+                              const ImageTolerance& tol) {
+    ImageDiff r;
+    size_t pixels = a.size() / 3;
+    double sq_err = 0;
+    for (size_t i = 0; i < pixels; ++i) {
+        int pixel_max = 0;
+        for (int c = 0; c < 3; ++c) {
+            int d = abs(int(a[i * 3 + c]) - int(b[i * 3 + c]));
+            sq_err += double(d) * d;
+            pixel_max = max(pixel_max, d);
+        }
+        r.max_diff = max(r.max_diff, pixel_max);
+        if (pixel_max > tol.pixel_tol) ++r.bad_pixels;
+    }
+    double mse = pixels ? sq_err / (pixels * 3.0) : 0.0;
+    if (mse > 0) r.psnr = 10.0 * log10(255.0 * 255.0 / mse);
+    r.passed = r.bad_pixels <= tol.max_bad_ratio * pixels && r.psnr >= tol.min_psnr;
+    return r;
+}
+
+// Grey version of 'a' with bad pixels painted red (brighter = larger difference)
+inline vector<unsigned char> diff_image_rgb8(const vector<unsigned char>& a, const vector<unsigned char>& b,
+                                             const ImageTolerance& tol) {
+    vector<unsigned char> out(a.size());
+    for (size_t i = 0; i < a.size() / 3; ++i) {
+        int pixel_max = 0, luma = 0;
+        for (int c = 0; c < 3; ++c) {
+            pixel_max = max(pixel_max, abs(int(a[i * 3 + c]) - int(b[i * 3 + c])));
+            luma += a[i * 3 + c];
+        }
+        unsigned char grey = static_cast<unsigned char>(luma / 12);   // darkened so red stands out
+        if (pixel_max > tol.pixel_tol) {
+            out[i * 3 + 0] = static_cast<unsigned char>(min(255, 128 + pixel_max * 4));
+            out[i * 3 + 1] = 0;
+            out[i * 3 + 2] = 0;
+        } else {
+            out[i * 3 + 0] = out[i * 3 + 1] = out[i * 3 + 2] = grey;
+        }
+    }
+    return out;
+}
+
+#endif
@@ -5,7 +5,8 @@
 #include <cmath>
 #include <algorithm>
 #include <filesystem>
-#include <unordered_map>
+#include <future>
+#include <sstream>
 #include <omp.h> // OpenMP parallel rendering
 
 // Third-party library 
@@ -20,145 +21,387 @@ using json = nlohmann::json;
 #include "vec3.h"
 #include "material.h"
 #include "sphere.h"
+#include "scene.h"
+#include "scene_bin.h"
 #include "render.h"
-#include "background.h"
-#include "camera.h"
+#include "image.h"
+#include "server.h"
+#include "distributed.h"
+#include "checkpoint.h"
+#include "preview.h"
+#include "framebuffer.h"
+#include "image_stream.h"
+#include "aov.h"
+#include "denoise.h"
 
 using namespace std;
 
 int depthMax;
 
-// argc = 2, argv[1] = depthMax
+// Render every frame of scene.animation into out/frame_XXXX.png (and .pfm with hdr).
+// Scene, envmap and BVH are shared by all frames, keyframed spheres only refit the BVH. Two framebuffers are used so a
+// finished frame is encoded on a background thread while the next one renders.
+static void render_animation(Scene& scene, bool hdr) {
+    const Camera base_cam = scene.cam;
+    const int width  = scene.width;
+    const int height = scene.height;
+    vector<vec3> framebuffers[2] = {vector<vec3>(width * height), vector<vec3>(width * height)};
+    future<void> writers[2];
+
+    auto start_time = chrono::high_resolution_clock::now();
+    for (int frame = 0; frame < scene.animation.frames; ++frame) {
+        int slot = frame % 2;
+        if (writers[slot].valid()) writers[slot].get();   // buffer still being written?
+
+        scene.cam = scene.animation.camera_at(frame, base_cam);
+        auto frame_start = chrono::high_resolution_clock::now();
+        bool rebuilt = update_animated_spheres(scene, frame);
+        auto update_end = chrono::high_resolution_clock::now();
+        render(scene, framebuffers[slot]);
+        auto frame_end = chrono::high_resolution_clock::now();
+        cout << "Frame " << frame << ": BVH " << (rebuilt ? "rebuilt" : "refit") << " in "
+             << chrono::duration_cast<chrono::microseconds>(update_end - frame_start).count() << " us, render "
+             << chrono::duration_cast<chrono::milliseconds>(frame_end - update_end).count() << " ms" << endl;
+
+        char path[64];
+        snprintf(path, sizeof(path), "out/frame_%04d.png", frame);
+        writers[slot] = async(launch::async, [path = string(path), &fb = framebuffers[slot], width, height, hdr] {
+            save_png(path, width, height, fb);
+            if (hdr) save_pfm(path.substr(0, path.size() - 4) + ".pfm", width, height, fb);
+        });
+    }
+    for (auto& w : writers) if (w.valid()) w.get();
+    scene.cam = base_cam;
+
+    auto duration = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start_time).count();
+    cout << "Animation: " << scene.animation.frames << " frames in " << duration << " ms" << endl;
+}
+
+// Render in strips of full rows. With 'stream' every finished strip goes straight to the
+// output files, otherwise it is packed into a framebuffer of the given format first.
+static void render_strips(const Scene& scene, FramebufferFormat format, bool stream, bool hdr) {
+    const int width = scene.width, height = scene.height;
+    const int strip_rows = max(1, min(height, (1 << 18) / max(1, width)));
+
+    ImageStreamWriter writers[3];
+    writers[0].open("out/out.ppm", ImageStreamWriter::Kind::PPM, width, height);
+    writers[1].open("out/out.png", ImageStreamWriter::Kind::PNG, width, height);
+    if (hdr) writers[2].open("out/out.pfm", ImageStreamWriter::Kind::PFM, width, height);
+    auto emit = [&](const vector<vec3>& rows, int count) {
+        for (int i = 0; i < (hdr ? 3 : 2); ++i) writers[i].write_rows(rows.data(), count);
+    };
+
+    PackedFramebuffer packed(stream ? 0 : width, stream ? 0 : height, format);
+    vector<vec3> strip;
+    for (int y0 = 0; y0 < height; y0 += strip_rows) {
+        const int y1 = min(height, y0 + strip_rows);
+        render_tile(scene, 0, y0, width, y1, strip);
+        if (stream) emit(strip, y1 - y0);
+        else packed.store(size_t(y0) * width, strip.data(), strip.size());
+    }
+    if (!stream) {
+        printf("Framebuffer: %.1f MiB\n", packed.bytes() / 1048576.0);
+        for (int y0 = 0; y0 < height; y0 += strip_rows) {
+            const int y1 = min(height, y0 + strip_rows);
+            strip.resize(size_t(y1 - y0) * width);
+            packed.load(size_t(y0) * width, strip.data(), strip.size());
+            emit(strip, y1 - y0);
+        }
+    }
+    for (int i = 0; i < (hdr ? 3 : 2); ++i) writers[i].close();
+}
+
+// argc = 3, argv[1] = depthMax, argv[2] = scene file (.json or .rtsb, default scene.json)
+// or: --server <socket path> to keep scenes resident and take jobs over a Unix socket
+// or: --worker [host:]port to take tile jobs over TCP from a coordinator
+// or: --workers host:port,... / --spawn N to render the frame in tiles on worker processes
+// --checkpoint <seconds> saves progress to out/checkpoint.rtck, --resume continues from it
+// --crop x0,y0,x1,y1 only traces that window, --merge <image> pastes it into an existing render
+// --preview writes quick, progressively refined pictures to out/preview.png before the final image
+// --hdr also writes the unclamped float image (out/out.pfm, out/frame_XXXX.pfm), see tonemap.cpp
+// --fb half|rgb9e5 keeps the frame in a compact format, --stream writes strips as they finish
+// --aov depth,normal,albedo,id,variance also writes those passes (out/aov_<pass>.pfm / .png)
+// --denoise filters the result guided by those passes (the noisy one goes to out/out_noisy.png)
+// --tex-budget <MB> caps the shared cache of inflated .rttx texture tiles (default 256),
+//                   each render thread may hold up to 64 more tiles on top of it
 int main(int argc, char* argv[]) {
     depthMax = 4; 
-    if (argc >= 2) {
+    vector<string> args;
+    string server_socket, worker_address;
+    int worker_fd = -1, spawn_workers = 0;
+    DistributedOptions dist;
+    double checkpoint_interval = 0;     // seconds, 0 = no checkpoints
+    bool resume = false;
+    CropWindow cli_crop;
+    string merge_path;                  // paste the crop into this full-size image
+    int preview_stride = 0;             // > 0: progressive preview starting at this grid stride
+    bool hdr = false;                   // also write the float framebuffer as .pfm
+    FramebufferFormat fb_format = FramebufferFormat::Float;
+    bool stream = false;                // write finished strips instead of keeping the frame
+    unsigned aov_mask = 0;              // AovPass bits, extra passes written to out/aov_*
+    bool denoise_output = false;        // filter the frame guided by normal / albedo / depth
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string a = argv[i];
+            bool has_value = i + 1 < argc;
+            if (a == "--server" && has_value) server_socket = argv[++i];
+            else if (a == "--worker" && has_value) worker_address = argv[++i];
+            else if (a == "--worker-fd" && has_value) worker_fd = stoi(argv[++i]);   // set by --spawn
+            else if (a == "--spawn" && has_value) spawn_workers = stoi(argv[++i]);
+            else if (a == "--tile" && has_value) dist.tile_size = stoi(argv[++i]);
+            else if (a == "--tile-timeout" && has_value) dist.tile_timeout = stod(argv[++i]);
+            else if (a == "--checkpoint" && has_value) checkpoint_interval = stod(argv[++i]);
+            else if (a == "--resume") resume = true;
+            else if (a == "--crop" && has_value) cli_crop = parse_crop(argv[++i]);
+            else if (a == "--merge" && has_value) merge_path = argv[++i];
+            else if (a == "--hdr") hdr = true;
+            else if (a == "--fb" && has_value) fb_format = framebuffer_format_by_name(argv[++i]);
+            else if (a == "--stream") stream = true;
+            else if (a == "--aov" && has_value) aov_mask = parse_aov_list(argv[++i]);
+            else if (a == "--denoise") denoise_output = true;
+            else if (a == "--tex-budget" && has_value) TextureCache::global().set_budget(size_t(stoul(argv[++i])) << 20);
+            else if (a == "--preview") preview_stride = max(preview_stride, 8);
+            else if (a == "--preview-stride" && has_value) preview_stride = stoi(argv[++i]);
+            else if (a == "--workers" && has_value) {
+                stringstream list(argv[++i]);
+                for (string w; getline(list, w, ',');) if (!w.empty()) dist.workers.push_back(w);
+            }
+            else args.push_back(a);
+        }
+    } catch (...) {
+        cerr << "Bad option value\n";
+        return 1;
+    }
+    if (args.size() >= 1) {
         try {
-            depthMax = stoi(argv[1]); 
+            depthMax = stoi(args[0]); 
             if (depthMax < 0 || depthMax > 100 ) {
                 cerr << "Invalid depth. Must be >= 0.\n";
                 return 1;
             }
         } catch (...) {
-            cerr << "Usage: " << argv[0] << " <max_recursion_depth>\n";
+            cerr << "Usage: " << argv[0] << " <max_recursion_depth> [scene file] [--checkpoint seconds] [--resume]"
+                 << " [--crop x0,y0,x1,y1 [--merge image]] [--preview] [--preview-stride N] [--hdr]"
+                 << " [--fb float|half|rgb9e5] [--stream] [--aov depth,normal,albedo,id,variance] [--denoise]"
+                 << " [--tex-budget MB]\n"
+                 << "       " << argv[0] << " [max_recursion_depth] --server <socket path>\n"
+                 << "       " << argv[0] << " --worker [host:]port\n"
+                 << "       " << argv[0] << " <max_recursion_depth> [scene file] --workers host:port,... | --spawn N"
+                 << " [--tile size] [--tile-timeout seconds]\n";
             return 1;
         }
     }
-    unordered_map<string, Material> material_map = {
-        {"ivory",       ivory},
-        {"glass",       glass},
-        {"mirror",      mirror},
-        {"red_rubber",  red_rubber},
-        {"gold",        gold},
-        {"emerald",     emerald},
-        {"steel",       steel},
-        {"ice",         ice}
-    };
+    string scene_path = args.size() >= 2 ? args[1] : "scene.json";
+
+    if (!server_socket.empty() || !worker_address.empty() || worker_fd >= 0) {
+#ifndef _WIN32
+        RenderServer server;
+        if (worker_fd >= 0) {
+            server.serve(worker_fd);
+            return 0;
+        }
+        return worker_address.empty() ? server.run(server_socket) : server.run_tcp(worker_address);
+#else
+        cerr << "--server and --worker are not available on this platform\n";
+        return 1;
+#endif
+    }
+    const bool distributed = !dist.workers.empty() || spawn_workers > 0;
 
 /*------------------------ load config from scene.json -------------------------*/
-    json config;
-    ifstream in("scene.json");
-    in >> config;
-
-    int width  = config["width"];
-    int height = config["height"];
-
-    // when failed to load cam
-    vec3 camera_pos = {0, 0, 0};
-    vec3 look_at = {0, 0, -1};
-    float fov = 1.0;
-    float aperture = 0.0f;
-    float focus_dist = 1.0f;
-    if (config.contains("camera"))
-    {
-        auto cam = config["camera"];
-        camera_pos = vec3{cam["position"][0], cam["position"][1], cam["position"][2]};
-        look_at    = vec3{cam["look_at"][0],   cam["look_at"][1],   cam["look_at"][2]};
-        fov        = cam["fov"];
-        aperture   = cam["aperture"];
-        focus_dist      = cam["focus_dist"];
-    }
-    Camera cam(camera_pos, look_at, fov, aperture, focus_dist);
-
-    Background bg;
-    bg.color = vec3{0.2f, 0.7f, 0.8f}; // color when failed to load any background
-    if (config.contains("background")) {
-        auto b = config["background"];
-        if (b["type"] == "image" && b.contains("path")) {
-            string path = b["path"];
-            bg.image_data = stbi_load(path.c_str(), &bg.width, &bg.height, &bg.channels, 0);
-            if (!bg.image_data) {
-                cerr << "Failed to load envmap, fallback to color.\n";
-            }
+    Scene scene;
+    try {
+        scene = load_scene_file(scene_path);
+    } catch (const exception& e) {
+        cerr << "Failed to load " << scene_path << ": " << e.what() << "\n";
+        return 1;
+    }
+    filesystem::create_directories("out");
+    if (cli_crop.enabled()) scene.crop = cli_crop;
+    if (scene.crop.enabled() && (distributed || scene.animation.enabled() || checkpoint_interval > 0 || resume)) {
+        cerr << "A crop window cannot be combined with distributed, animation or checkpointed rendering\n";
+        return 1;
+    }
+    if (scene.animation.enabled() && (checkpoint_interval > 0 || resume)) {
+        cerr << "--checkpoint and --resume only work for a single-frame render, not an animation\n";
+        return 1;
+    }
+    if (preview_stride > 0 && (distributed || scene.animation.enabled() || scene.crop.enabled() ||
+                               checkpoint_interval > 0 || resume)) {
+        cerr << "--preview only works for a plain single-frame render\n";
+        return 1;
+    }
+    const bool strips = stream || fb_format != FramebufferFormat::Float;
+    if (strips && (distributed || scene.animation.enabled() || scene.crop.enabled() || preview_stride > 0 ||
+                   checkpoint_interval > 0 || resume)) {
+        cerr << "--fb and --stream only work for a plain single-frame render\n";
+        return 1;
+    }
+    if ((aov_mask || denoise_output) && (distributed || scene.animation.enabled() || scene.crop.enabled() || preview_stride > 0 ||
+                     checkpoint_interval > 0 || resume || strips)) {
+        cerr << "--aov and --denoise only work for a plain single-frame render\n";
+        return 1;
+    }
+    int preview_pow2 = 1;               // grids halve each pass, so round the stride down to a power of two
+    while (preview_pow2 * 2 <= preview_stride) preview_pow2 *= 2;
+
+    if (distributed) {
+#ifndef _WIN32
+        // The workers build their own BVHs, the coordinator only needs the frame size
+        if (scene.animation.enabled()) {
+            cerr << "Animations are not supported in distributed mode\n";
+            return 1;
         }
-        if (b.contains("default")) {
-            auto d = b["default"];
-            bg.color = vec3{d[0], d[1], d[2]};
+        vector<LocalWorker> local;
+        if (spawn_workers > 0) {
+            string exe = filesystem::exists("/proc/self/exe") ? filesystem::read_symlink("/proc/self/exe").string()
+                                                              : string(argv[0]);
+            local = spawn_local_workers(exe, spawn_workers);
+            for (const LocalWorker& w : local) dist.workers.push_back("127.0.0.1:" + to_string(w.port));
         }
+        vector<vec3> framebuffer(scene.width * scene.height);
+        auto start_time = chrono::high_resolution_clock::now();
+        render_distributed(scene_path, scene, dist, framebuffer);
+        auto duration = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start_time).count();
+        cout << "Render time: " << duration << " ms (" << dist.workers.size() << " workers)" << endl;
+        stop_local_workers(local);
+
+        save_ppm("out/out.ppm", scene.width, scene.height, framebuffer);
+        save_png("out/out.png", scene.width, scene.height, framebuffer);
+        if (hdr) save_pfm("out/out.pfm", scene.width, scene.height, framebuffer);
+        return 0;
+#else
+        cerr << "Distributed rendering is not available on this platform\n";
+        return 1;
+#endif
     }
-    
-    vector<vec3> framebuffer(width * height);
 
-    vector<vec3> lights;
-    for (auto& l : config["lights"]) {
-        lights.push_back(vec3{l[0], l[1], l[2]});
+    auto bvh_start = chrono::high_resolution_clock::now();
+    bool bvh_cached = prepare_bvh(scene, "cache");
+    auto bvh_ms = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - bvh_start).count();
+    cout << "BVH " << (bvh_cached ? "loaded from cache" : "built") << " in " << bvh_ms << " ms" << endl;
+
+    if (scene.animation.enabled()) {
+        render_animation(scene, hdr);
+        return 0;
     }
 
-    vector<Sphere> spheres;
-    for (auto& s : config["spheres"]) {
-        vec3 center = {s["center"][0], s["center"][1], s["center"][2]};
-        float radius = s["radius"];
-        std::string mname = s["material"];
+    const int width  = scene.width;
+    const int height = scene.height;
+
+/*------------------------ crop window only -------------------------*/
+    if (scene.crop.enabled()) {
+        int x0, y0, x1, y1;
+        try {
+            tie(x0, y0, x1, y1) = scene.crop.pixels(width, height);
+        } catch (const exception& e) {
+            cerr << e.what() << "\n";
+            return 1;
+        }
+        const int crop_w = x1 - x0, crop_h = y1 - y0;
+        vector<vec3> tile;
+        auto start_time = chrono::high_resolution_clock::now();
+        render_tile(scene, x0, y0, x1, y1, tile);
+        auto duration = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start_time).count();
+        cout << "Render time: " << duration << " ms (crop " << x0 << "," << y0 << " - " << x1 << "," << y1 << ")" << endl;
+
+        if (merge_path.empty()) {
+            save_ppm("out/out.ppm", crop_w, crop_h, tile);
+            save_png("out/out.png", crop_w, crop_h, tile);
+            if (hdr) save_pfm("out/out.pfm", crop_w, crop_h, tile);
+            return 0;
+        }
+        if (hdr) cout << "--merge only merges the 8-bit images, out/out.pfm is not written" << endl;
+        // Paste into the full frame rendered earlier
+        int base_w, base_h, base_c;
+        unsigned char* base = stbi_load(merge_path.c_str(), &base_w, &base_h, &base_c, 3);
+        if (!base || base_w != width || base_h != height) {
+            cerr << "Cannot merge: " << merge_path << " is missing or not " << width << "x" << height << "\n";
+            if (base) stbi_image_free(base);
+            return 1;
+        }
+        vector<unsigned char> merged(base, base + size_t(width) * height * 3);
+        stbi_image_free(base);
+        vector<unsigned char> crop_rgb = framebuffer_to_rgb8(tile);
+        for (int y = 0; y < crop_h; ++y) {
+            copy_n(crop_rgb.begin() + size_t(y) * crop_w * 3, crop_w * 3,
+                   merged.begin() + (size_t(y0 + y) * width + x0) * 3);
+        }
+        save_ppm_rgb8("out/out.ppm", width, height, merged);
+        save_png_rgb8("out/out.png", width, height, merged);
+        return 0;
+    }
 
-        Material m = material_map.count(mname) ? material_map[mname] : mirror;
-        spheres.emplace_back(center, radius, m);
+/*------------------ compact or streamed framebuffer ------------------*/
+    if (strips) {
+        auto start_time = chrono::high_resolution_clock::now();
+        render_strips(scene, fb_format, stream, hdr);
+        auto duration = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start_time).count();
+        cout << "Render time: " << duration << " ms (including output)" << endl;
+        return 0;
     }
 
 /*------------------------ main(parallelized) -------------------------*/
+    vector<vec3> framebuffer(width * height);
     auto start_time = chrono::high_resolution_clock::now(); // Start timing
-#pragma omp parallel 
-{
-    #pragma omp for
-    for (int pix = 0; pix < width * height; ++pix) {
-
-        vec3 ray_origin, ray_dir;      // pos and dir of the ray
-
-        if (cam.aperture > 0.0f) {     // Check whether depth of field is needed
-            cam.get_ray_with_dof(pix, width, height, ray_origin, ray_dir);
+    if (checkpoint_interval > 0 || resume) {
+        const string checkpoint_path = "out/checkpoint.rtck";
+        const uint64_t scene_hash = file_content_hash(scene_path);
+        Checkpoint ck;
+        if (resume && load_checkpoint(checkpoint_path, ck) && ck.matches(scene, scene_hash)) {
+            size_t done = 0;
+            for (uint32_t n : ck.samples) done += n;
+            cout << "Resuming from " << checkpoint_path << " (" << done << " of "
+                 << size_t(width) * height * scene.spp << " samples done)" << endl;
         } else {
-            ray_origin = cam.position;
-            ray_dir = cam.get_ray_dir(pix, width, height);
-        }        
-        // Cast a ray from ray_origin in direction ray_dir and compute its resulting color.
-        framebuffer[pix] = cast_ray(ray_origin, ray_dir, cam, spheres, lights, bg, 0);
+            if (resume) cout << "No checkpoint for this scene and depth, starting from scratch" << endl;
+            ck.reset(scene, scene_hash);
+        }
+        if (!render_checkpointed(scene, ck, checkpoint_path, checkpoint_interval > 0 ? checkpoint_interval : 60,
+                                 framebuffer)) {
+            cout << "Stopped, progress saved to " << checkpoint_path << ". Continue with --resume." << endl;
+            return 2;
+        }
+        error_code ec;
+        filesystem::remove(checkpoint_path, ec);
+    } else if (preview_stride > 0) {
+        render_progressive(scene, framebuffer, preview_pow2, "out/preview.png");
+    } else if (aov_mask || denoise_output) {
+        const unsigned denoise_mask = AOV_DEPTH | AOV_NORMAL | AOV_ALBEDO | AOV_VARIANCE;
+        AovBuffers aovs(aov_mask | (denoise_output ? denoise_mask : 0u), width, height);
+        render_with_aovs(scene, framebuffer, aovs);
+        if (aov_mask) {
+            aovs.mask = aov_mask;               // only write the passes that were asked for
+            save_aovs("out/aov", aovs);
+        }
+        if (denoise_output) {
+            save_png("out/out_noisy.png", width, height, framebuffer);
+            auto denoise_start = chrono::high_resolution_clock::now();
+            denoise(width, height, framebuffer, aovs.normal, aovs.albedo, aovs.depth, aovs.variance, framebuffer);
+            cout << "Denoise time: " << chrono::duration_cast<chrono::milliseconds>(
+                        chrono::high_resolution_clock::now() - denoise_start).count() << " ms" << endl;
+        }
+    } else {
+        render(scene, framebuffer);
     }
-}
     auto end_time = chrono::high_resolution_clock::now(); // End timing
     auto duration = chrono::duration_cast<chrono::milliseconds>(end_time - start_time).count();
     cout << "Render time: " << duration << " ms" << endl;
+    if (scene.bg.tiled) {
+        auto st = TextureCache::global().stats();
+        cout << "Texture cache: " << st.decodes << " tiles inflated, " << st.evictions << " evicted, "
+             << (st.resident_bytes >> 20) << " of " << (TextureCache::global().budget() >> 20) << " MB in the shared cache" << endl;
+    }
 
 /*------------------------------- save -------------------------------*/
-    filesystem::create_directories("out");
-
     // Save framebuffer to .ppm file
-    ofstream ofs("out/out.ppm", ios::binary);
-    ofs << "P6\n" << width << " " << height << "\n255\n";
-    for (const vec3& color : framebuffer) {
-        float max_c = max(1.f, max(color[0], max(color[1], color[2])));
-        for (int i = 0; i < 3; ++i) {
-            ofs << (char)(255 * color[i] / max_c);
-        }
-    }
-    ofs.close();
+    save_ppm("out/out.ppm", width, height, framebuffer);
 
     // Save framebuffer to .png using stb_image_write
-    vector<unsigned char> img_data(width * height * 3);
-    for (int i = 0; i < width * height; ++i) {
-        float max_c = max(1.f, max(framebuffer[i][0], max(framebuffer[i][1], framebuffer[i][2])));
-        img_data[i * 3 + 0] = static_cast<unsigned char>(255 * framebuffer[i][0] / max_c);
-        img_data[i * 3 + 1] = static_cast<unsigned char>(255 * framebuffer[i][1] / max_c);
-        img_data[i * 3 + 2] = static_cast<unsigned char>(255 * framebuffer[i][2] / max_c);
-    }
-    stbi_write_png("out/out.png", width, height, 3, img_data.data(), width * 3);
+    save_png("out/out.png", width, height, framebuffer);
+
+    // Unclamped floats for re-exposing later (tonemap.cpp)
+    if (hdr) save_pfm("out/out.pfm", width, height, framebuffer);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,81 @@
+// Description: Read-only memory mapped file (mmap on POSIX, plain read on Windows).
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const string& path) { open(path); }
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& o) noexcept { *this = std::move(o); }
+    MappedFile& operator=(MappedFile&& o) noexcept {
+        if (this != &o) {
+            close();
+            data_ = o.data_; size_ = o.size_; buffer_ = std::move(o.buffer_);
+            o.data_ = nullptr; o.size_ = 0;
+        }
+        return *this;
+    }
+
+    bool open(const string& path) {
+        close();
+#ifdef _WIN32
+        ifstream in(path, ios::binary | ios::ate);
+        if (!in) return false;
+        buffer_.resize(size_t(in.tellg()));
+        in.seekg(0);
+        in.read(buffer_.data(), buffer_.size());
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) { ::close(fd); return false; }
+        void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);                       // the mapping keeps the file alive
+        if (p == MAP_FAILED) return false;
+        data_ = static_cast<const char*>(p);
+        size_ = size_t(st.st_size);
+#endif
+        return true;
+    }
+
+    void close() {
+#ifndef _WIN32
+        if (data_) munmap(const_cast<char*>(data_), size_);
+#endif
+        buffer_.clear();
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool is_open() const { return data_ != nullptr; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    vector<char> buffer_;                  // only used without mmap
+};
+
+#endif
@@ -2,6 +2,8 @@
 #define MATERIAL_H
 
 #include "vec3.h"
+#include <stdexcept>
+#include <string>
 
 // Material definition, pls read the doc to understand
 struct Material {
@@ -11,6 +13,17 @@ struct Material {
     float specular_exponent = 0.0f;    // 镜面高光指数 / Specular exponent
 };
 
+// How materials with refraction split their reflection + refraction albedo (scene "fresnel").
+// Off keeps the fixed albedo[2] / albedo[3] weights.
+enum class FresnelModel { Off, Schlick, Exact };
+
+inline FresnelModel fresnel_model_by_name(const std::string& name) {
+    if (name == "off") return FresnelModel::Off;
+    if (name == "schlick") return FresnelModel::Schlick;
+    if (name == "exact") return FresnelModel::Exact;
+    throw std::runtime_error("unknown fresnel model " + name + " (off, schlick or exact)");
+}
+
 // Common predefined materials
 constexpr Material ivory = {
     1.0f,
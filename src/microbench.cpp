@@ -0,0 +1,202 @@
+// Microbenchmarks for the hot kernels, each timed on its own with a fixed,
+// reproducible input set. Reports ns/op and throughput (Mops/s).
+//
+// Build: g++ -std=c++17 -O2 -o microbench src/microbench.cpp
+// Usage: ./microbench [name filter] [--min-time ms]
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <string>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "include/stb_image_write.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "include/stb_image.h"
+
+#include "scene.h"
+#include "scenegen.h"
+#include "render.h"
+#include "image.h"
+
+using namespace std;
+
+int depthMax = 4;
+
+static volatile float sink;     // results are folded in here so nothing is optimized away
+static double min_time_ms = 300;
+
+// Fixed seed, platform independent floats in [lo, hi)
+struct InputRng {
+    mt19937 rng{12345};
+    float operator()(float lo, float hi) {
+        return lo + (hi - lo) * ((rng() >> 8) * (1.f / 16777216.f));
+    }
+    vec3 unit_vec() {
+        vec3 v;
+        do { v = {(*this)(-1, 1), (*this)(-1, 1), (*this)(-1, 1)}; } while (v * v > 1 || v * v < 1e-4f);
+        return v.normalized();
+    }
+};
+
+// Run 'body' (which performs 'ops_per_call' operations) until min_time_ms has elapsed
+static void run(const string& name, size_t ops_per_call, const function<float()>& body) {
+    using clock = chrono::high_resolution_clock;
+    body();                                              // warm-up
+    size_t calls = 0;
+    float acc = 0;
+    auto t0 = clock::now();
+    double elapsed_ms = 0;
+    do {
+        acc += body();
+        ++calls;
+        elapsed_ms = chrono::duration<double, milli>(clock::now() - t0).count();
+    } while (elapsed_ms < min_time_ms);
+    sink = acc;
+
+    double ops = double(calls) * ops_per_call;
+    double ns_per_op = elapsed_ms * 1e6 / ops;
+    printf("%-28s %12.2f ns/op %12.2f Mops/s %12zu ops\n",
+           name.c_str(), ns_per_op, 1e3 / ns_per_op, size_t(ops));
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[]) {
+    string filter;
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        if (a == "--min-time" && i + 1 < argc) min_time_ms = stod(argv[++i]);
+        else filter = a;
+    }
+    auto enabled = [&](const string& name) { return name.find(filter) != string::npos; };
+
+    const int N = 4096;
+    InputRng in;
+
+    // Shared inputs: scene with 64 mixed spheres, rays from around the camera
+    SceneGenParams gp;
+    gp.num_spheres = 64;
+    gp.dof = true;
+    Scene scene = generate_scene(gp);
+    vector<vec3> origins(N), dirs(N), normals(N);
+    for (int i = 0; i < N; ++i) {
+        origins[i] = {in(-1, 1), in(-1, 1), in(-1, 1)};
+        vec3 d = in.unit_vec();
+        d.z = -abs(d.z);                                 // mostly towards the spheres
+        dirs[i] = d.normalized();
+        normals[i] = in.unit_vec();
+    }
+
+    if (enabled("ray_sphere_intersect")) {
+        run("ray_sphere_intersect", size_t(N) * scene.spheres.size(), [&] {
+            float acc = 0;
+            for (int i = 0; i < N; ++i)
+                for (const Sphere& s : scene.spheres) {
+                    auto [hit, dist] = ray_sphere_intersect(origins[i], dirs[i], s);
+                    acc += hit ? dist : 0.f;
+                }
+            return acc;
+        });
+    }
+
+    if (enabled("scene_intersect")) {
+        run("scene_intersect (linear)", N, [&] {
+            float acc = 0;
+            for (int i = 0; i < N; ++i) {
+                auto [hit, pt, n, m, id] = scene_intersect(origins[i], dirs[i], scene);
+                acc += hit ? pt.z : 0.f;
+            }
+            return acc;
+        });
+        prepare_bvh(scene, "");
+        run("scene_intersect (bvh)", N, [&] {
+            float acc = 0;
+            for (int i = 0; i < N; ++i) {
+                auto [hit, pt, n, m, id] = scene_intersect(origins[i], dirs[i], scene);
+                acc += hit ? pt.z : 0.f;
+            }
+            return acc;
+        });
+        scene.bvh = BVH();
+    }
+
+    if (enabled("reflect")) {
+        run("reflect", N, [&] {
+            float acc = 0;
+            for (int i = 0; i < N; ++i) acc += reflect(dirs[i], normals[i]).x;
+            return acc;
+        });
+    }
+
+    if (enabled("refract")) {
+        run("refract", N, [&] {
+            float acc = 0;
+            vec3 t{0, 0, 0};
+            for (int i = 0; i < N; ++i) acc += refract(dirs[i], normals[i], 1.5f, t) ? t.x : 0.f;
+            return acc;
+        });
+    }
+
+    if (enabled("Background::sample")) {
+        // Synthetic 2048x1024 RGB envmap, so no asset file is needed
+        Background bg;
+        bg.width = 2048; bg.height = 1024; bg.channels = 3;
+        vector<unsigned char> pixels(size_t(bg.width) * bg.height * 3);
+        for (auto& p : pixels) p = static_cast<unsigned char>(in.rng() & 0xff);
+        bg.image_data = pixels.data();
+        run("Background::sample", N, [&] {
+            float acc = 0;
+            for (int i = 0; i < N; ++i) acc += bg.sample(dirs[i]).y;
+            return acc;
+        });
+        bg.image_data = nullptr;
+    }
+
+    const int width = 640, height = 480;
+    if (enabled("Camera::get_ray_dir")) {
+        run("Camera::get_ray_dir", size_t(width) * height, [&] {
+            float acc = 0;
+            for (int pix = 0; pix < width * height; ++pix) acc += scene.cam.get_ray_dir(pix, width, height).x;
+            return acc;
+        });
+    }
+
+    if (enabled("Camera::get_ray_with_dof")) {
+        run("Camera::get_ray_with_dof", size_t(width) * height, [&] {
+            float acc = 0;
+            vec3 o, d;
+            for (int pix = 0; pix < width * height; ++pix) {
+                scene.cam.get_ray_with_dof(pix, width, height, o, d);
+                acc += o.x + d.x;
+            }
+            return acc;
+        });
+    }
+
+    // Output loop, per pixel. Framebuffer has values above 1 like a real render.
+    vector<vec3> framebuffer(size_t(width) * height);
+    for (auto& c : framebuffer) c = {in(0, 2), in(0, 2), in(0, 2)};
+
+    if (enabled("output::ppm")) {
+        run("output::ppm", framebuffer.size(), [&] {
+            ostringstream os;
+            write_ppm(os, width, height, framebuffer);
+            return float(os.tellp());
+        });
+    }
+
+    if (enabled("output::png")) {
+        run("output::png", framebuffer.size(), [&] {
+            vector<unsigned char> img_data = framebuffer_to_rgb8(framebuffer);
+            size_t bytes = 0;
+            stbi_write_png_to_func([](void* ctx, void*, int size) { *static_cast<size_t*>(ctx) += size; },
+                                   &bytes, width, height, 3, img_data.data(), width * 3);
+            return float(bytes);
+        });
+    }
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+// Description: Small POSIX socket helpers (Unix domain and TCP sockets) shared by the
+//              render server and the tile coordinator. Messages are JSON lines,
+//              optionally followed by raw bytes.
+#ifndef NET_H
+#define NET_H
+
+#ifndef _WIN32
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+using namespace std;
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// Listen on a Unix domain socket, an old socket file at 'path' is replaced. Any other file
+// there is left alone and the call fails with EEXIST. Returns fd or -1.
+inline int unix_listen(const string& path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) { errno = ENAMETOOLONG; return -1; }
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) { errno = EEXIST; return -1; }
+        unlink(path.c_str());
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+inline int unix_connect(const string& path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// "host:port" or "port" (host defaults to 'default_host', loopback unless told otherwise).
+// Returns false on a bad port.
+inline bool parse_host_port(const string& spec, string& host, int& port, const string& default_host = "127.0.0.1") {
+    size_t colon = spec.rfind(':');
+    host = colon == string::npos ? default_host : spec.substr(0, colon);
+    string p = colon == string::npos ? spec : spec.substr(colon + 1);
+    if (p.empty() || p.find_first_not_of("0123456789") != string::npos || p.size() > 5) return false;
+    port = stoi(p);
+    return port <= 65535;
+}
+
+// Small request/reply messages, don't let Nagle hold them back (no-op on Unix sockets)
+inline void set_nodelay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// recv() fails with EAGAIN once no byte arrived for 'ms' milliseconds (0 = wait forever)
+inline void set_recv_timeout(int fd, int ms) {
+    timeval tv{};
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+// Listen on TCP host:port (port 0 = any free port, see socket_port). Returns fd or -1.
+inline int tcp_listen(const string& host, int port) {
+    addrinfo hints{}, *res = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if (getaddrinfo(host.empty() ? nullptr : host.c_str(), to_string(port).c_str(), &hints, &res) != 0) return -1;
+    int fd = -1;
+    for (addrinfo* a = res; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, a->ai_addr, a->ai_addrlen) != 0 || listen(fd, 16) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+inline int tcp_connect(const string& host, int port) {
+    addrinfo hints{}, *res = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &res) != 0) return -1;
+    int fd = -1;
+    for (addrinfo* a = res; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (fd >= 0) set_nodelay(fd);
+    return fd;
+}
+
+// Port a TCP socket is bound to, -1 on error
+inline int socket_port(int fd) {
+    sockaddr_storage addr{};
+    socklen_t len = sizeof(addr);
+    if (getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) return -1;
+    if (addr.ss_family == AF_INET) return ntohs(reinterpret_cast<sockaddr_in*>(&addr)->sin_port);
+    if (addr.ss_family == AF_INET6) return ntohs(reinterpret_cast<sockaddr_in6*>(&addr)->sin6_port);
+    return -1;
+}
+
+inline bool write_all(int fd, const void* data, size_t bytes) {
+    const char* p = static_cast<const char*>(data);
+    while (bytes > 0) {
+        ssize_t n = send(fd, p, bytes, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        bytes -= size_t(n);
+    }
+    return true;
+}
+
+inline bool write_line(int fd, const string& line) {
+    return write_all(fd, line.data(), line.size()) && write_all(fd, "\n", 1);
+}
+
+// Buffered reader for "JSON line + payload" messages
+struct SocketReader {
+    int fd;
+    string buf;
+
+    explicit SocketReader(int fd_) : fd(fd_) {}
+
+    bool fill() {
+        char tmp[65536];
+        ssize_t n;
+        do { n = recv(fd, tmp, sizeof(tmp), 0); } while (n < 0 && errno == EINTR);
+        if (n <= 0) return false;
+        buf.append(tmp, size_t(n));
+        return true;
+    }
+
+    // Line without the '\n'. Fails on EOF, error or a line longer than max_len.
+    bool read_line(string& line, size_t max_len = 64 << 20) {
+        size_t pos, scanned = 0;        // bytes already searched, each fill only scans the new ones
+        while ((pos = buf.find('\n', scanned)) == string::npos) {
+            scanned = buf.size();
+            if (buf.size() > max_len || !fill()) return false;
+        }
+        line = buf.substr(0, pos);
+        buf.erase(0, pos + 1);
+        return true;
+    }
+
+    bool read_exact(void* out, size_t bytes) {
+        while (buf.size() < bytes) {
+            if (!fill()) return false;
+        }
+        memcpy(out, buf.data(), bytes);
+        buf.erase(0, bytes);
+        return true;
+    }
+};
+
+#endif // _WIN32
+
+#endif
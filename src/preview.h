@@ -0,0 +1,90 @@
+// Description: Progressive preview. A cheap draft (every Nth pixel, shallow rays, no DOF,
+//              one sample) comes first. Then full-quality passes on grids of stride
+//              N, N/2, ..., 1 follow. Each pass only traces the pixels the coarser grids
+//              have not traced yet, so every final pixel is traced exactly once. After each
+//              pass the gaps are filled by bilinear upsampling of the grid traced so far.
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include "scene.h"
+#include "render.h"
+#include "image.h"
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+extern int depthMax;
+
+// Fill every pixel from the grid of multiples of 'stride' (which must be traced already)
+inline void upsample_grid(const vector<vec3>& grid, int width, int height, int stride, vector<vec3>& out) {
+    out.resize(size_t(width) * height);
+    const int last_x = (width - 1) / stride * stride, last_y = (height - 1) / stride * stride;
+#pragma omp parallel for
+    for (int y = 0; y < height; ++y) {
+        int ya = min(y / stride * stride, last_y), yb = min(ya + stride, last_y);
+        float fy = yb > ya ? float(y - ya) / float(yb - ya) : 0.f;
+        for (int x = 0; x < width; ++x) {
+            int xa = min(x / stride * stride, last_x), xb = min(xa + stride, last_x);
+            float fx = xb > xa ? float(x - xa) / float(xb - xa) : 0.f;
+            vec3 top = grid[size_t(ya) * width + xa] * (1 - fx) + grid[size_t(ya) * width + xb] * fx;
+            vec3 bot = grid[size_t(yb) * width + xa] * (1 - fx) + grid[size_t(yb) * width + xb] * fx;
+            out[size_t(y) * width + x] = top * (1 - fy) + bot * fy;
+        }
+    }
+}
+
+// Render 'scene' into framebuffer progressively, writing the intermediate pictures to
+// preview_path. The final framebuffer equals render(). stride must be a power of two.
+inline void render_progressive(Scene& scene, vector<vec3>& framebuffer, int stride, const string& preview_path) {
+    const int width = scene.width, height = scene.height;
+    vector<vec3> shown;
+    future<void> writer;
+    auto start_time = chrono::high_resolution_clock::now();
+    auto show = [&](const vector<vec3>& grid, int grid_stride, const char* what) {
+        if (writer.valid()) writer.get();       // previous preview still being written?
+        upsample_grid(grid, width, height, grid_stride, shown);
+        auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start_time).count();
+        cout << "Preview " << what << " (stride " << grid_stride << ") at " << ms << " ms" << endl;
+        writer = async(launch::async, [&shown, &preview_path, width, height] {
+            save_png(preview_path, width, height, shown);
+        });
+    };
+
+    // Draft: 1 spp, no DOF, shallow rays. Thrown away once the real passes start.
+    {
+        const Camera cam = scene.cam;
+        const int spp = scene.spp, depth = depthMax;
+        scene.cam.aperture = 0;
+        scene.spp = 1;
+        depthMax = min(depthMax, 1);
+        vector<vec3> draft(size_t(width) * height);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int y = 0; y < height; y += stride) {
+            for (int x = 0; x < width; x += stride) draft[size_t(y) * width + x] = render_pixel(scene, y * width + x);
+        }
+        scene.cam = cam;
+        scene.spp = spp;
+        depthMax = depth;
+        show(draft, stride, "draft");
+    }
+
+    // Full quality, coarse to fine. A pixel on the grid of 2 * s was traced by an earlier pass.
+    for (int s = stride; s >= 1; s /= 2) {
+        const bool first = s == stride;
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int y = 0; y < height; y += s) {
+            const bool coarse_row = y % (2 * s) == 0;
+            for (int x = 0; x < width; x += s) {
+                if (!first && coarse_row && x % (2 * s) == 0) continue;
+                framebuffer[size_t(y) * width + x] = render_pixel(scene, y * width + x);
+            }
+        }
+        if (s > 1) show(framebuffer, s, "pass");
+    }
+    if (writer.valid()) writer.get();
+}
+
+#endif
@@ -8,17 +8,40 @@
 #include "sphere.h"
 #include "background.h"
 #include "camera.h"
+#include "scene.h"
+#include "sampler.h"
+#include "envlight.h"
 #include <cmath>
+#include <limits>
 #include <tuple>
 #include <vector>
 using namespace std;
 extern int depthMax; 
 
+// Optional ray counter for benchmarking (compile with -DRT_RAY_STATS).
+// Every scene_intersect call counts as one ray (camera, secondary or shadow).
+#ifdef RT_RAY_STATS
+inline thread_local unsigned long long ray_stats_count = 0;
+#endif
+
 // Calculate reflection vector (Specular Reflection)
 inline vec3 reflect(const vec3& I, const vec3& N) {
     return I - N * 2.f * (I * N);
 }
 
+// Origin for a secondary ray leaving surface point p in direction d. N is the surface normal
+// and p_error bounds the rounding error of each coordinate of p (hit_point_error). The point
+// is pushed along the normal, to the side d goes to, just past that error, so the ray never
+// hits the surface it starts on, at any scene scale. Same idea as Ray Tracing Gems ch. 6
+// ("A Fast and Robust Method for Avoiding Self-Intersection"), but with the error bound of
+// pbrt instead of a fixed number of ulps: that moved refracted rays by a visible part of the
+// radius of small spheres far from the origin.
+inline vec3 offset_ray_origin(const vec3& p, const vec3& p_error, const vec3& N, const vec3& d) {
+    const vec3 n = d * N < 0 ? -N : N;
+    float dist = abs(n.x) * p_error.x + abs(n.y) * p_error.y + abs(n.z) * p_error.z;
+    return p + n * dist;
+}
+
 // Snellの法則に基づく屈折ベクトルを計算する関数
 // Calculate the refraction vector based on Snell's Law
 //
@@ -29,90 +52,301 @@ inline vec3 reflect(const vec3& I, const vec3& N) {
 //      Unit normal vector at the surface
 // - eta_t: 出射媒質の屈折率（例：ガラスなら 1.5）
 //          Refractive index of the transmission medium
+// - T: 屈折ベクトル（全反射なら変更しない）
+//      Refracted direction, left untouched on total internal reflection
 // - eta_i: 入射媒質の屈折率（省略時は空気 = 1.0）
 //          Refractive index of the incident medium
 //
-// 全反射の場合は無効なベクトル（{1, 0, 0}）を返す。
-// Returns invalid vector ({1, 0, 0}) if total internal reflection occurs.
-inline vec3 refract(const vec3& I, const vec3& N, float eta_t, float eta_i = 1.f) {
+// 全反射の場合は false を返す。
+// Returns false if total internal reflection occurs (there is no refracted ray).
+inline bool refract(const vec3& I, const vec3& N, float eta_t, vec3& T, float eta_i = 1.f) {
     float cosi = -max(-1.f, min(1.f, I * N));  // Cosine of incidence angle
-    if (cosi < 0) return refract(I, -N, eta_i, eta_t); 
+    if (cosi < 0) return refract(I, -N, eta_i, T, eta_t);
 
     float eta = eta_i / eta_t;                // 屈折率の比 / Ratio of refractive indices
     float k = 1 - eta * eta * (1 - cosi * cosi);  // 全反射の判定 / Discriminant for total internal reflection
 
     // k < 0 ⇒ 全反射/ Total internal reflection
-    return k < 0 ? vec3{1, 0, 0} : I * eta + N * (eta * cosi - sqrt(k)); 
+    if (k < 0) return false;
+    T = I * eta + N * (eta * cosi - sqrt(k));
+    return true;
+}
+
+// Fresnel reflectance of a dielectric for cos_i (incident side) and the refractive indices
+// of both sides. 1 under total internal reflection.
+inline float fresnel_exact(float cos_i, float eta_i, float eta_t) {
+    float sin_t = eta_i / eta_t * sqrt(max(0.f, 1.f - cos_i * cos_i));
+    if (sin_t >= 1.f) return 1.f;
+    float cos_t = sqrt(max(0.f, 1.f - sin_t * sin_t));
+    float rs = (eta_i * cos_i - eta_t * cos_t) / (eta_i * cos_i + eta_t * cos_t);
+    float rp = (eta_t * cos_i - eta_i * cos_t) / (eta_t * cos_i + eta_i * cos_t);
+    return 0.5f * (rs * rs + rp * rp);
+}
+
+// Schlick's approximation of the same. Leaving the denser medium it takes the angle on the
+// thinner side, so it also gives 1 under total internal reflection.
+inline float fresnel_schlick(float cos_i, float eta_i, float eta_t) {
+    float r0 = (eta_i - eta_t) / (eta_i + eta_t);
+    r0 *= r0;
+    float c = cos_i;
+    if (eta_i > eta_t) {
+        float sin_t2 = (eta_i / eta_t) * (eta_i / eta_t) * (1.f - cos_i * cos_i);
+        if (sin_t2 >= 1.f) return 1.f;
+        c = sqrt(1.f - sin_t2);
+    }
+    float m = 1.f - c;
+    return r0 + (1.f - r0) * m * m * m * m * m;
+}
+
+// Reflected fraction for direction I hitting a surface with outward normal N, index eta
+// inside and air outside
+inline float fresnel_reflectance(const vec3& I, const vec3& N, float eta, FresnelModel model) {
+    float cos_i = -(I * N), eta_i = 1.f, eta_t = eta;
+    if (cos_i < 0) {        // leaving the object
+        cos_i = -cos_i;
+        swap(eta_i, eta_t);
+    }
+    cos_i = min(cos_i, 1.f);
+    return model == FresnelModel::Exact ? fresnel_exact(cos_i, eta_i, eta_t) : fresnel_schlick(cos_i, eta_i, eta_t);
 }
 
-// Test if a ray intersects with any object in the scene
-// 返回：是否命中、交点位置、法向量、材质
-inline tuple<bool, vec3, vec3, Material> scene_intersect(
+// Object ids in the scene_intersect result: index into scene.spheres, or one of these
+constexpr int NO_OBJECT_ID = -1;
+constexpr int FLOOR_OBJECT_ID = -2;
+
+// Test if a ray intersects with any object in the scene (moving spheres at shutter time 'time')
+// 返回：是否命中、交点位置、法向量、材质、物体编号
+inline tuple<bool, vec3, vec3, Material, int> scene_intersect(
     const vec3& orig, const vec3& dir,
-    const vector<Sphere>& spheres
+    const Scene& scene,
+    float time = 0.f
 ) {
+#ifdef RT_RAY_STATS
+    ++ray_stats_count;
+#endif
     vec3 pt, N;
     Material material;
+    int object_id = NO_OBJECT_ID;
     float nearest_dist = 1e10;
 
     // board floor 
     if (abs(dir.y) > 0.001f) {
         float d = -(orig.y + 4) / dir.y;
         vec3 p = orig + dir * d;
-        if (d > 0.001f && d < nearest_dist && abs(p.x) < 10 && p.z < -10 && p.z > -30) {
+        if (d > 0 && d < nearest_dist && abs(p.x) < 10 && p.z < -10 && p.z > -30) {
             nearest_dist = d;
-            pt = p;
+            pt = {p.x, -4, p.z};    // exactly on the plane
             N = {0, 1, 0};
             bool checker = (int(0.5f * pt.x + 1000) + int(0.5f * pt.z)) % 2;
             material.diffuse_color = checker ? vec3{0.3, 0.3, 0.3} : vec3{0.3, 0.2, 0.1};
+            object_id = FLOOR_OBJECT_ID;
         }
     }
 
-    // spheres
-    for (const Sphere& s : spheres) {
-        auto [hit, dist] = ray_sphere_intersect(orig, dir, s);
-        if (hit && dist < nearest_dist) {
-            nearest_dist = dist;
-            pt = orig + dir * dist;
-            N = (pt - s.center).normalized();
+    // spheres, through the BVH when one was built
+    if (!scene.bvh.empty()) {
+        int idx = bvh_intersect(scene.bvh, scene.spheres, orig, dir, nearest_dist, time);
+        if (idx >= 0) {
+            const Sphere& s = scene.spheres[idx];
+            vec3 c = s.center_at(time);
+            N = (orig + dir * nearest_dist - c).normalized();
+            pt = c + N * s.radius;      // back onto the sphere, the error no longer grows with distance
             material = s.material;
+            object_id = idx;
+        }
+    } else {
+        for (size_t i = 0; i < scene.spheres.size(); ++i) {
+            const Sphere& s = scene.spheres[i];
+            auto [hit, dist] = ray_sphere_intersect(orig, dir, s, time);
+            if (hit && dist < nearest_dist) {
+                nearest_dist = dist;
+                vec3 c = s.center_at(time);
+                N = (orig + dir * dist - c).normalized();
+                pt = c + N * s.radius;
+                material = s.material;
+                object_id = int(i);
+            }
         }
     }
 
-    return {nearest_dist < 1000, pt, N, material};
+    return {nearest_dist < 1000, pt, N, material, object_id};
+}
+
+// Bound on the rounding error of each coordinate of a scene_intersect hit point, plus the
+// rounding of offset_ray_origin itself. Sphere hits are c + N * r: a few roundings of terms
+// no larger than |p| + 2r. Floor hits have y exact, only the offset rounds (x and z errors
+// do not move them off the plane).
+inline vec3 hit_point_error(const Scene& scene, int object_id, const vec3& p) {
+    constexpr float GAMMA = 6 * numeric_limits<float>::epsilon();
+    if (object_id < 0) return {0, 4 * GAMMA, 0};
+    const float r2 = 2 * scene.spheres[object_id].radius;
+    return vec3{abs(p.x) + r2, abs(p.y) + r2, abs(p.z) + r2} * GAMMA;
+}
+
+// What a camera ray hit first, for the AOV passes (aov.h)
+struct AovSample {
+    bool hit = false;
+    float depth = 0;            // distance along the ray
+    vec3 normal = {0, 0, 0};
+    vec3 albedo = {0, 0, 0};    // diffuse color of the surface, background color on a miss
+    int object_id = NO_OBJECT_ID;
+    float variance = 0;         // per pixel: variance of the mean luminance over the samples (spp > 1)
+};
+
+// Direction around 'axis' with pdf (n + 1) / (2 pi) * cos^n, the Phong lobe of exponent n
+inline vec3 sample_phong_lobe(const vec3& axis, float n, float u1, float u2) {
+    float cos_a = pow(u1, 1.f / (n + 1.f));
+    float sin_a = sqrt(max(0.f, 1.f - cos_a * cos_a));
+    float phi = 2.f * float(M_PI) * u2;
+    vec3 t = cross(abs(axis.x) > 0.9f ? vec3{0, 1, 0} : vec3{1, 0, 0}, axis).normalized();
+    vec3 b = cross(axis, t);
+    return (t * (cos(phi) * sin_a) + b * (sin(phi) * sin_a) + axis * cos_a).normalized();
+}
+
+// Image-based lighting at 'point': the envmap acts as a dense set of point lights, radiance
+// L / pi per steradian, with the same diffuse (cos) and Phong specular (cos^n) terms as
+// scene.lights. Diffuse is estimated with envmap samples. Specular combines envmap samples
+// and samples of the Phong lobe with the power heuristic, so neither sharp highlights nor
+// a small bright sun turn into fireflies. Every direction is checked with an occlusion ray.
+inline vec3 ibl_lighting(const vec3& point, const vec3& point_error, const vec3& N, const vec3& dir,
+                         const Material& material, const Scene& scene, float time, int depth, PixelSampler& sampler) {
+    const Background& bg = scene.bg;
+    const EnvDistribution& dist = *bg.ibl;
+    const bool diffuse = material.albedo[0] != 0, specular = material.albedo[1] != 0;
+    if (!diffuse && !specular) return {0, 0, 0};
+
+    const float n = material.specular_exponent;
+    const float lobe_norm = (n + 1.f) / (2.f * float(M_PI));
+    const vec3 R = reflect(dir, N).normalized();            // axis of the highlight lobe
+    const float lobe_width = n > 0 ? 2.f * acos(pow(0.5f, 1.f / n)) : float(M_PI);   // full width at half maximum
+    auto visible = [&](const vec3& d) {
+        return !get<0>(scene_intersect(offset_ray_origin(point, point_error, N, d), d, scene, time));
+    };
+
+    vec3 diffuse_sum = {0, 0, 0}, specular_sum = {0, 0, 0};
+    for (int i = 0; i < bg.ibl_samples; ++i) {
+        const uint32_t dim = DIM_LIGHT + 4 * uint32_t(depth * bg.ibl_samples + i);
+
+        float pdf_env;
+        auto [u1, u2] = sampler.get2d(dim);
+        vec3 wi = env_sample(dist, u1, u2, pdf_env);
+        float cos_n = wi * N;
+        if (pdf_env > 0 && cos_n > 0 && visible(wi)) {
+            vec3 L = bg.sample(wi) * (1.f / float(M_PI));
+            if (diffuse) diffuse_sum = diffuse_sum + L * (cos_n / pdf_env);
+            if (specular) {
+                float pdf_lobe = lobe_norm * pow(max(0.f, wi * R), n);
+                float w = pdf_env * pdf_env / (pdf_env * pdf_env + pdf_lobe * pdf_lobe);
+                specular_sum = specular_sum + L * (pdf_lobe / lobe_norm / pdf_env * w);
+            }
+        }
+
+        if (!specular) continue;
+        auto [v1, v2] = sampler.get2d(dim + 2);
+        vec3 wl = sample_phong_lobe(R, n, v1, v2);
+        if (wl * N > 0 && visible(wl)) {
+            float pdf_lobe = lobe_norm * pow(max(0.f, wl * R), n);
+            float pdf_e = env_pdf(dist, wl);
+            float w = pdf_lobe * pdf_lobe / (pdf_lobe * pdf_lobe + pdf_e * pdf_e);
+            specular_sum = specular_sum + bg.sample(wl, lobe_width) * (1.f / float(M_PI) / lobe_norm * w);   // cos^n / pdf_lobe = 1 / lobe_norm
+        }
+    }
+    const float scale = bg.ibl_intensity / bg.ibl_samples;
+    return (mul(material.diffuse_color, diffuse_sum) * material.albedo[0] + specular_sum * material.albedo[1]) * scale;
 }
 
+// Footprint of a ray for filtered envmap lookups (ray cone tracing): its width at the origin
+// and the angle it widens by per unit of distance
+struct RayCone {
+    float width = 0, spread = 0;
+};
+
 /*----------------- Recursive ray tracing -----------------*/ 
 // Cast a ray from 'orig' in direction 'dir' and compute its resulting color.
-inline vec3 cast_ray(
+// 'time' is the ray's shutter time, secondary and shadow rays keep it.
+// 'aov', if given, receives the first hit of this ray (camera rays only).
+// 'sampler' provides the random numbers for image-based lighting, without it there is none.
+// 'cone' is the ray's footprint, for envmap filtering.
+// ENV: the scene has an envmap. The version without it returns the solid color on a miss and
+// has no footprint or image-based lighting code on the per-hit path. cast_ray() picks one.
+template <bool ENV>
+inline vec3 trace_ray(
     const vec3& orig, const vec3& dir,
-    const Camera& cam, 
-    const vector<Sphere>& spheres,
-    const vector<vec3>& lights,
-    const Background& background,
-    int depth = 0
+    const Scene& scene,
+    int depth,
+    float time,
+    AovSample* aov,
+    PixelSampler* sampler,
+    RayCone cone
 ) {
+    const Background& background = scene.bg;
     if (depth > depthMax) return background.color;
 
-    auto [hit, point, N, material] = scene_intersect(orig, dir, spheres);
-    if (!hit) return background.sample(dir);
+    auto [hit, point, N, material, object_id] = scene_intersect(orig, dir, scene, time);
+    if (aov) {
+        aov->hit = hit;
+        aov->depth = hit ? (point - orig).norm() : 0.f;
+        aov->normal = hit ? N : vec3{0, 0, 0};
+        aov->albedo = hit ? material.diffuse_color : ENV ? background.sample(dir) : background.color;
+        aov->object_id = object_id;
+    }
+    if (!hit) return ENV ? background.sample(dir, cone.spread) : background.color;
+    const vec3 point_error = hit_point_error(scene, object_id, point);   // secondary rays start past it
+
+    // Widen the cone to the hit point. A sphere's curvature spreads the reflected cone further.
+    RayCone reflect_cone = cone, refract_cone = cone;
+    if (ENV && background.filter == EnvFilter::Cone) {
+        float width = cone.width + cone.spread * (point - orig).norm();
+        float curvature = object_id >= 0 ? 1.f / scene.spheres[object_id].radius : 0.f;
+        reflect_cone = {width, cone.spread + 2.f * width * curvature};
+        refract_cone = {width, cone.spread};
+    }
+
+    // Weights of the reflected and refracted rays. With a Fresnel model, materials that refract
+    // share albedo[2] + albedo[3] between the two by the Fresnel term. With fresnel_split only
+    // one of them is traced, picked with the Fresnel probability, at the full weight.
+    float reflect_weight = material.albedo[2], refract_weight = material.albedo[3];
+    if (scene.fresnel != FresnelModel::Off && material.albedo[3] > 0) {
+        float F = fresnel_reflectance(dir, N, material.refractive_index, scene.fresnel);
+        float k = material.albedo[2] + material.albedo[3];
+        reflect_weight = k * F;
+        refract_weight = k * (1.f - F);
+        if (scene.fresnel_split && sampler && F > 0 && F < 1) {
+            bool pick_reflect = sampler->get1d(DIM_FRESNEL + depth) < F;
+            reflect_weight = pick_reflect ? k : 0.f;
+            refract_weight = pick_reflect ? 0.f : k;
+        }
+    }
 
-    // Compute and normalize reflection and refraction directions
-    vec3 reflect_dir = reflect(dir, N).normalized();
-    vec3 refract_dir = refract(dir, N, material.refractive_index).normalized();
+    // 全反射: there is no refracted ray, all of its energy goes to the reflection
+    vec3 refract_dir;
+    if (refract_weight != 0 && !refract(dir, N, material.refractive_index, refract_dir)) {
+        reflect_weight += refract_weight;
+        refract_weight = 0;
+    }
 
     // ! important ! : Recursively trace reflected and refracted rays to get their resulting color.
-    // 再帰的に追跡
-    vec3 reflect_color = cast_ray(point, reflect_dir, cam, spheres, lights, background, depth + 1);
-    vec3 refract_color = cast_ray(point, refract_dir, cam, spheres, lights, background, depth + 1);
+    // 再帰的に追跡. A branch with weight 0 adds nothing and is not traced.
+    vec3 reflect_color = {0, 0, 0}, refract_color = {0, 0, 0};
+    if (reflect_weight != 0) {
+        vec3 reflect_dir = reflect(dir, N).normalized();
+        vec3 reflect_orig = offset_ray_origin(point, point_error, N, reflect_dir);
+        reflect_color = trace_ray<ENV>(reflect_orig, reflect_dir, scene, depth + 1, time, nullptr, sampler, reflect_cone);
+    }
+    if (refract_weight != 0) {
+        refract_dir = refract_dir.normalized();
+        vec3 refract_orig = offset_ray_origin(point, point_error, N, refract_dir);
+        refract_color = trace_ray<ENV>(refract_orig, refract_dir, scene, depth + 1, time, nullptr, sampler, refract_cone);
+    }
 
 
     // Initialize diffuse and specular light intensity. Loop over each point light.
     float diffuse_light_intensity = 0, specular_light_intensity = 0;
-    for (const vec3& light : lights) {
+    for (const vec3& light : scene.lights) {
         //若中途遇到遮挡物（即在阴影中），则跳过该光源的贡献
         vec3 light_dir = (light - point).normalized();
-        auto [shadow_hit, shadow_pt, trashnrm, trashmat] = scene_intersect(point, light_dir, spheres);
+        auto [shadow_hit, shadow_pt, trashnrm, trashmat, trashid] =
+            scene_intersect(offset_ray_origin(point, point_error, N, light_dir), light_dir, scene, time);
         if (shadow_hit && (shadow_pt - point).norm() < (light - point).norm()) continue;
         
         // 漫反射 = 入射光与法向夹角的余弦值，取非负。
@@ -133,10 +367,113 @@ inline vec3 cast_ray(
 
     // 再帰で得られた色
     // Reflection component — color seen from recursively tracing the reflected ray
-         + reflect_color * material.albedo[2]
+         + reflect_color * reflect_weight
 
     // Refraction component — recursively computed color for rays passing through transparent materials
-         + refract_color * material.albedo[3];
+         + refract_color * refract_weight
+
+    // Image-based lighting, when the envmap lights the scene
+         + (ENV && sampler && background.ibl ? ibl_lighting(point, point_error, N, dir, material, scene, time, depth, *sampler) : vec3{0, 0, 0});
+}
+
+inline vec3 cast_ray(
+    const vec3& orig, const vec3& dir,
+    const Scene& scene,
+    int depth = 0,
+    float time = 0.f,
+    AovSample* aov = nullptr,
+    PixelSampler* sampler = nullptr,
+    RayCone cone = RayCone()
+) {
+    return scene.bg.has_image() ? trace_ray<true>(orig, dir, scene, depth, time, aov, sampler, cone)
+                                : trace_ray<false>(orig, dir, scene, depth, time, aov, sampler, cone);
+}
+
+/*----------------- Render a whole frame (parallelized) -----------------*/
+// Color of sample 's' of pixel 'pix'. The sample takes its sub-pixel position, lens position
+// and shutter time from the scene's sampler at (pix, seed, s), so it does not depend on
+// thread scheduling, on which tile (or process) renders the pixel, or on the samples traced
+// before it.
+inline vec3 render_sample(const Scene& scene, int pix, int s, AovSample* aov = nullptr) {
+    const Camera& cam = scene.cam;
+    PixelSampler sampler(scene.sampler, pix, scene.width, cam.seed, s, scene.spp);
+    vec3 ray_origin = cam.position, ray_dir;      // pos and dir of the ray
+
+    if (scene.jitter && scene.spp > 1) {
+        auto [jx, jy] = sampler.get2d(DIM_PIXEL);
+        ray_dir = cam.get_ray_dir(pix % scene.width + jx, pix / scene.width + jy, scene.width, scene.height);
+    } else {
+        ray_dir = cam.get_ray_dir(pix, scene.width, scene.height);
+    }
+    if (cam.aperture > 0.0f) {     // Check whether depth of field is needed
+        vec3 pinhole_dir = ray_dir;
+        auto [r1, r2] = sampler.get2d(DIM_LENS);
+        cam.get_ray_with_dof(pinhole_dir, r1, r2, ray_origin, ray_dir);
+    }
+    float time = cam.shutter_close > cam.shutter_open ? cam.sample_time(sampler.get1d(DIM_TIME)) : cam.shutter_open;
+    // Cast a ray from ray_origin in direction ray_dir and compute its resulting color.
+    // A camera ray starts as wide as the lens spot (ignored) and spreads by one pixel's angle
+    RayCone cone = {0.f, 2.f * tan(cam.fov / 2.f) / scene.height};
+    return cast_ray(ray_origin, ray_dir, scene, 0, time, aov, &sampler, cone);
+}
+
+// Average of scene.spp samples. Samples are summed in order, a resumed render (checkpoint.h)
+// accumulates the same way and gets the same bits.
+// With 'aov': normal and albedo are averaged over the samples, depth over the samples that
+// hit something, and the object id is the one of the first sample.
+inline vec3 render_pixel(const Scene& scene, int pix, AovSample* aov = nullptr) {
+    vec3 color = {0, 0, 0};
+    AovSample sample_aov;
+    int hits = 0;
+    float lum_sum = 0, lum_sum2 = 0;
+    for (int s = 0; s < scene.spp; ++s) {
+        vec3 c = render_sample(scene, pix, s, aov ? &sample_aov : nullptr);
+        color = color + c;
+        if (!aov) continue;
+        float lum = 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+        lum_sum += lum;
+        lum_sum2 += lum * lum;
+        if (s == 0) *aov = sample_aov;
+        else {
+            aov->normal = aov->normal + sample_aov.normal;
+            aov->albedo = aov->albedo + sample_aov.albedo;
+            aov->depth += sample_aov.depth;
+        }
+        hits += sample_aov.hit;
+    }
+    if (aov && scene.spp > 1) {
+        aov->normal = aov->normal.norm() > 0 ? aov->normal.normalized() : aov->normal;
+        aov->albedo = aov->albedo * (1.f / scene.spp);
+        aov->depth = hits > 0 ? aov->depth / hits : 0.f;
+        float n = float(scene.spp);
+        aov->variance = max(0.f, lum_sum2 - lum_sum * lum_sum / n) / ((n - 1) * n);
+    }
+    return color * (1.f / scene.spp);
+}
+
+// Framebuffer must hold width * height entries
+inline void render(const Scene& scene, vector<vec3>& framebuffer) {
+    const int width = scene.width, height = scene.height;
+#pragma omp parallel 
+{
+    #pragma omp for
+    for (int pix = 0; pix < width * height; ++pix) {
+        framebuffer[pix] = render_pixel(scene, pix);
+    }
+}
+}
+
+// Render only the rectangle [x0, x1) x [y0, y1) of the full frame into 'tile'
+// (row-major, (x1 - x0) * (y1 - y0) entries). Pixels match render() exactly.
+inline void render_tile(const Scene& scene, int x0, int y0, int x1, int y1, vector<vec3>& tile) {
+    const int tile_w = x1 - x0, tile_h = y1 - y0;
+    tile.resize(size_t(tile_w) * tile_h);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int j = 0; j < tile_h; ++j) {
+        for (int i = 0; i < tile_w; ++i) {
+            tile[size_t(j) * tile_w + i] = render_pixel(scene, (y0 + j) * scene.width + (x0 + i));
+        }
+    }
 }
 
 #endif
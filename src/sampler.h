@@ -0,0 +1,194 @@
+// Description: Per-sample random numbers for the camera (pixel jitter, lens, shutter time)
+//              and for light sampling. Every consumer reads its own fixed dimension, and a
+//              dimension is a function of (pixel, seed, sample index) only, so renders stay
+//              reproducible no matter how the frame is split. Besides plain random numbers
+//              there are stratified (correlated multi-jittered), Owen-scrambled Sobol and a
+//              blue-noise-like variant that spreads the error evenly over the screen.
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "camera.h"
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+using namespace std;
+
+enum class SamplerType { Random, Stratified, Sobol, BlueNoise };
+
+inline SamplerType sampler_by_name(const string& name) {
+    if (name == "random") return SamplerType::Random;
+    if (name == "stratified") return SamplerType::Stratified;
+    if (name == "sobol") return SamplerType::Sobol;
+    if (name == "bluenoise") return SamplerType::BlueNoise;
+    throw runtime_error("unknown sampler " + name + " (random, stratified, sobol or bluenoise)");
+}
+
+inline const char* sampler_name(SamplerType type) {
+    switch (type) {
+        case SamplerType::Stratified: return "stratified";
+        case SamplerType::Sobol: return "sobol";
+        case SamplerType::BlueNoise: return "bluenoise";
+        default: return "random";
+    }
+}
+
+// First dimension of each consumer. 2D consumers use dim and dim + 1.
+enum SampleDim : uint32_t {
+    DIM_PIXEL = 0,      // sub-pixel position
+    DIM_LENS  = 2,      // point on the aperture
+    DIM_TIME  = 4,      // shutter time
+    DIM_LIGHT = 5,      // light / environment sampling, one pair per light sample
+    DIM_FRESNEL = 1u << 16,     // reflect or refract, DIM_FRESNEL + depth (clear of the light pairs)
+};
+
+inline uint32_t reverse_bits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+// First two Sobol dimensions as 32-bit fixed point. Together they form a (0,2)-sequence:
+// every power-of-two prefix is stratified in every elementary interval.
+inline uint32_t sobol_u32(uint32_t index, int dim) {
+    if (dim == 0) return reverse_bits(index);
+    uint32_t result = 0;
+    for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1) {
+        if (index & 1) result ^= v;
+    }
+    return result;
+}
+
+// Owen scrambling by hashing (Burley 2020, "Practical Hash-based Owen Scrambling"). Each bit
+// is flipped depending only on the bits above it, so the stratification survives.
+inline uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+inline uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+    return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+}
+
+// Kensler's hash permutation of [0, n), "Correlated Multi-Jittered Sampling" (2013)
+inline uint32_t permute_index(uint32_t i, uint32_t n, uint32_t p) {
+    if (n <= 1) return 0;
+    uint32_t w = n - 1;
+    w |= w >> 1; w |= w >> 2; w |= w >> 4; w |= w >> 8; w |= w >> 16;
+    do {
+        i ^= p; i *= 0xe170893du; i ^= p >> 16;
+        i ^= (i & w) >> 4; i ^= p >> 8; i *= 0x0929eb3fu;
+        i ^= p >> 23; i ^= (i & w) >> 1; i *= 1 | p >> 27;
+        i *= 0x6935fa69u; i ^= (i & w) >> 11; i *= 0x74dcb303u;
+        i ^= (i & w) >> 2; i *= 0x9e501cc3u; i ^= (i & w) >> 2;
+        i *= 0xc860a3dfu; i &= w; i ^= i >> 5;
+    } while (i >= n);
+    return (i + p) % n;
+}
+
+inline float u32_to_unit(uint32_t x) { return (x >> 8) * (1.f / 16777216.f); }     // [0, 1)
+
+// Sample 'sample' of 'spp' of one pixel.
+// Random keeps the PixelRng stream and hands out numbers in call order (this is what the
+// renderer always did, renders stay bit-identical). The others are indexed by dimension.
+class PixelSampler {
+public:
+    PixelSampler(SamplerType type, uint32_t pix, int width, uint32_t seed, uint32_t sample, uint32_t spp)
+        : type_(type), rng_(pix, seed, sample), pix_(pix), x_(pix % uint32_t(width)), y_(pix / uint32_t(width)),
+          seed_(seed), sample_(sample), spp_(spp) {}
+
+    float get1d(uint32_t dim) {
+        switch (type_) {
+            case SamplerType::Random: return rng_.next();
+            case SamplerType::Stratified: {
+                uint32_t h = dim_hash(dim);
+                uint32_t stratum = permute_index(sample_, spp_, h);
+                return min((stratum + u32_to_unit(hash_u32(sample_ ^ h))) / spp_, ONE_MINUS_EPS);
+            }
+            case SamplerType::Sobol: {
+                uint32_t h = dim_hash(dim);
+                uint32_t index = nested_uniform_scramble(sample_, h);
+                return u32_to_unit(nested_uniform_scramble(sobol_u32(index, 0), hash_u32(h)));
+            }
+            case SamplerType::BlueNoise: {
+                uint32_t index = nested_uniform_scramble(sample_, frame_hash(dim));
+                return wrap(u32_to_unit(sobol_u32(index, 0)) + screen_offset(dim));
+            }
+        }
+        return 0;
+    }
+
+    pair<float, float> get2d(uint32_t dim) {
+        switch (type_) {
+            case SamplerType::Random: {
+                float u = rng_.next();
+                float v = rng_.next();
+                return {u, v};
+            }
+            case SamplerType::Stratified: return multi_jittered(dim_hash(dim));
+            case SamplerType::Sobol: {
+                uint32_t h = dim_hash(dim);
+                uint32_t index = nested_uniform_scramble(sample_, h);
+                return {u32_to_unit(nested_uniform_scramble(sobol_u32(index, 0), hash_u32(h))),
+                        u32_to_unit(nested_uniform_scramble(sobol_u32(index, 1), hash_u32(h + 1)))};
+            }
+            case SamplerType::BlueNoise: {
+                uint32_t index = nested_uniform_scramble(sample_, frame_hash(dim));
+                return {wrap(u32_to_unit(sobol_u32(index, 0)) + screen_offset(dim)),
+                        wrap(u32_to_unit(sobol_u32(index, 1)) + screen_offset(dim + 1))};
+            }
+        }
+        return {0.f, 0.f};
+    }
+
+private:
+    static constexpr float ONE_MINUS_EPS = 0x1.fffffep-1f;
+
+    SamplerType type_;
+    PixelRng rng_;
+    uint32_t pix_, x_, y_, seed_, sample_, spp_;
+
+    // Independent per pixel and dimension
+    uint32_t dim_hash(uint32_t dim) const { return hash_u32(pix_ ^ hash_u32(seed_ + dim * 0x9e3779b9u)); }
+    // Same for every pixel: the blue-noise variant decorrelates pixels by their offsets only
+    uint32_t frame_hash(uint32_t dim) const { return hash_u32(seed_ ^ hash_u32(dim + 0x51633e2du)); }
+
+    static float wrap(float u) { return u >= 1.f ? u - 1.f : u; }
+
+    // Cranley-Patterson shift of the pixel: the R2 sequence over screen coordinates (Roberts'
+    // dither). Neighbouring pixels get well separated shifts, so the leftover error has little
+    // low-frequency content and reads as fine grain instead of blotches.
+    float screen_offset(uint32_t dim) const {
+        uint32_t salt = hash_u32(dim ^ seed_);
+        float x = float(x_ + (salt & 0xff)), y = float(y_ + ((salt >> 8) & 0xff));
+        if (dim & 1) swap(x, y);
+        double v = 0.5 + x * 0.7548776662466927 + y * 0.5698402909980532;
+        return float(v - floor(v));
+    }
+
+    // Kensler's correlated multi-jittered pattern: stratified in 2D and in both 1D projections,
+    // for any sample count
+    pair<float, float> multi_jittered(uint32_t p) const {
+        uint32_t n = spp_;
+        uint32_t m = uint32_t(ceil(sqrt(float(n))));
+        uint32_t rows = (n + m - 1) / m;
+        uint32_t s = permute_index(sample_, n, p * 0x51633e2du);
+        uint32_t sx = permute_index(s % m, m, p * 0xa511e9b3u);
+        uint32_t sy = permute_index(s / m, rows, p * 0x63d83595u);
+        float jx = u32_to_unit(hash_u32(s ^ (p * 0xa399d265u)));
+        float jy = u32_to_unit(hash_u32(s ^ (p * 0x711ad6a5u)));
+        float u = ((s % m) + (sy + jx) / rows) / m;
+        float v = ((s / m) + (sx + jy) / m) / rows;
+        return {min(u, ONE_MINUS_EPS), min(v, ONE_MINUS_EPS)};
+    }
+};
+
+#endif
@@ -0,0 +1,233 @@
+// Description: Scene description (resolution, camera, background, lights, spheres)
+//              and the loader that builds it from a scene.json file.
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "vec3.h"
+#include "material.h"
+#include "sphere.h"
+#include "background.h"
+#include "envlight.h"
+#include "camera.h"
+#include "sampler.h"
+#include "bvh.h"
+#include "animation.h"
+#include "crop.h"
+#include "include/json.hpp"
+#ifndef STBI_INCLUDE_STB_IMAGE_H   // the .cpp may already have pulled in the implementation
+#include "include/stb_image.h"
+#endif
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Everything needed to render one frame
+struct Scene {
+    int width = 0, height = 0;
+    int spp = 1;           // samples per pixel (DOF and motion blur samples)
+    SamplerType sampler = SamplerType::Random;     // where the samples' random numbers come from
+    bool jitter = false;   // with spp > 1, spread the samples over the pixel (anti-aliasing)
+    FresnelModel fresnel = FresnelModel::Off;      // reflection / refraction split of dielectrics
+    bool fresnel_split = true;     // with a Fresnel model: trace one of the two rays, picked by the Fresnel term
+    Camera cam;
+    Background bg;
+    vector<vec3> lights;
+    vector<Sphere> spheres;
+    BVH bvh;               // empty until prepare_bvh(), then spheres are tested through it
+    Animation animation;   // camera path, only used when the scene has "animation"
+    CropWindow crop;       // only trace this part of the frame (scene.json "crop" or --crop)
+};
+
+// Build the BVH over the spheres, or map it from cache_dir when the same geometry
+// was built before. Small scenes are always built, they are faster than a file open.
+// Returns true when the tree came from the cache.
+inline bool prepare_bvh(Scene& scene, const string& cache_dir = "cache") {
+    const Camera& cam = scene.cam;
+    auto build = [&] {
+        scene.bvh = build_bvh(scene.spheres);
+        if (has_motion(scene.spheres)) set_bvh_motion(scene.bvh, scene.spheres, cam.shutter_open, cam.shutter_close);
+    };
+    if (scene.spheres.size() < BVH_CACHE_MIN_SPHERES || cache_dir.empty()) {
+        build();
+        return false;
+    }
+    uint64_t hash = geometry_hash(scene.spheres, cam.shutter_open, cam.shutter_close);
+    string path = bvh_cache_path(cache_dir, hash);
+    scene.bvh = load_bvh_cache(path, hash, scene.spheres.size());
+    if (!scene.bvh.empty()) return true;
+
+    build();
+    if (!save_bvh_cache(path, scene.bvh, hash)) {
+        cerr << "Failed to write BVH cache " << path << "\n";
+    }
+    return false;
+}
+
+// Look up a predefined material by name, unknown names fall back to mirror
+inline Material material_by_name(const string& name) {
+    static const unordered_map<string, Material> material_map = {
+        {"ivory",       ivory},
+        {"glass",       glass},
+        {"mirror",      mirror},
+        {"red_rubber",  red_rubber},
+        {"gold",        gold},
+        {"emerald",     emerald},
+        {"steel",       steel},
+        {"ice",         ice}
+    };
+    auto it = material_map.find(name);
+    return it != material_map.end() ? it->second : mirror;
+}
+
+// Move the keyframed spheres to 'frame' and refit the BVH around them. Once the refit
+// tree's SAH cost grew past animation.rebuild_threshold times its cost after the last
+// build, the tree is rebuilt from scratch instead. Returns true when it was rebuilt.
+inline bool update_animated_spheres(Scene& scene, int frame) {
+    vector<uint32_t> moved;
+    for (const SphereTrack& track : scene.animation.sphere_tracks) {
+        vec3 c = track.center_at(frame);
+        vec3& center = scene.spheres[track.sphere].center;
+        if (c.x != center.x || c.y != center.y || c.z != center.z) {
+            center = c;
+            moved.push_back(track.sphere);
+        }
+    }
+    if (moved.empty() || scene.bvh.empty()) return false;
+
+    refit_bvh(scene.bvh, scene.spheres, moved);
+    if (bvh_sah_growth(scene.bvh) <= scene.animation.rebuild_threshold) return false;
+    scene.bvh = build_bvh(scene.spheres);
+    if (scene.bvh.end_bounds == nullptr && has_motion(scene.spheres)) {
+        set_bvh_motion(scene.bvh, scene.spheres, scene.cam.shutter_open, scene.cam.shutter_close);
+    }
+    return true;
+}
+
+// Open a tiled .rttx envmap through the texture cache (nothing is decoded yet)
+inline bool open_tiled_envmap(Background& bg, const string& path) {
+    try {
+        bg.tiled = TextureCache::global().open(path);
+    } catch (const exception& e) {
+        cerr << "Failed to open envmap " << e.what() << ", fallback to color.\n";
+        return false;
+    }
+    bg.width = bg.tiled->width();
+    bg.height = bg.tiled->height();
+    bg.channels = 3;
+    return true;
+}
+
+// Decode an envmap image into bg (or open it, for .rttx), bg.color stays as the fallback
+inline bool load_envmap(Background& bg, const string& path) {
+    bg.path = path;
+    if (is_tiled_texture(path)) {
+        if (!open_tiled_envmap(bg, path)) return false;
+    } else {
+        bg.image_data = stbi_load(path.c_str(), &bg.width, &bg.height, &bg.channels, 0);
+        if (!bg.image_data) {
+            cerr << "Failed to load envmap, fallback to color.\n";
+            return false;
+        }
+        if (bg.filter == EnvFilter::Cone) bg.mips = build_env_mips(bg);     // .rttx brings its own
+    }
+    if (bg.ibl_samples > 0) bg.ibl = build_env_distribution(bg);
+    return true;
+}
+
+// Camera from a json "camera" object, values that are left out keep the ones of 'base'
+inline Camera camera_from_json(const nlohmann::json& c, const Camera& base = Camera()) {
+    auto read_vec3 = [](const nlohmann::json& v) { return vec3{v[0], v[1], v[2]}; };
+    vec3 position    = c.contains("position")   ? read_vec3(c["position"]) : base.position;
+    vec3 look_at     = c.contains("look_at")    ? read_vec3(c["look_at"])  : base.position + base.forward;
+    float fov        = c.contains("fov")        ? float(c["fov"])          : base.fov;
+    float aperture   = c.contains("aperture")   ? float(c["aperture"])     : base.aperture;
+    float focus_dist = c.contains("focus_dist") ? float(c["focus_dist"])   : base.focus_dist;
+
+    Camera cam(position, look_at, fov, aperture, focus_dist);
+    cam.seed          = base.seed;
+    cam.shutter_open  = c.contains("shutter") ? float(c["shutter"][0]) : base.shutter_open;
+    cam.shutter_close = c.contains("shutter") ? float(c["shutter"][1]) : base.shutter_close;
+    return cam;
+}
+
+// Build a Scene from an already parsed json config.
+// With load_images = false the envmap path is kept but the image is not decoded.
+inline Scene scene_from_json(const nlohmann::json& config, bool load_images = true) {
+    Scene scene;
+    scene.width  = config.at("width");     // at() throws on a missing key instead of asserting
+    scene.height = config.at("height");
+
+    // when failed to load cam: looks down -Z from the origin
+    if (config.contains("camera")) scene.cam = camera_from_json(config["camera"]);
+    if (config.contains("seed")) scene.cam.seed = config["seed"];
+    scene.spp = max(1, config.value("spp", 1));
+    if (config.contains("sampler")) scene.sampler = sampler_by_name(config["sampler"]);
+    scene.jitter = config.value("jitter", false);
+    if (config.contains("fresnel")) {          // "schlick" / "exact", or {"model": ..., "split": "random" | "weight"}
+        auto f = config["fresnel"];
+        if (f.is_string()) scene.fresnel = fresnel_model_by_name(f);
+        else {
+            scene.fresnel = fresnel_model_by_name(f.value("model", "schlick"));
+            string split = f.value("split", "random");
+            if (split != "random" && split != "weight") throw runtime_error("fresnel split must be random or weight");
+            scene.fresnel_split = split == "random";
+        }
+    }
+    if (config.contains("crop")) scene.crop = crop_from_json(config["crop"]);
+
+    Background& bg = scene.bg;
+    bg.color = vec3{0.2f, 0.7f, 0.8f}; // color when failed to load any background
+    if (config.contains("background")) {
+        auto b = config["background"];
+        if (b.contains("ibl")) {        // true, or {"samples": n, "intensity": k}
+            auto ibl = b["ibl"];
+            if (ibl.is_boolean()) bg.ibl_samples = ibl.get<bool>() ? 4 : 0;
+            else {
+                bg.ibl_samples = max(0, ibl.value("samples", 4));
+                bg.ibl_intensity = ibl.value("intensity", 1.f);
+            }
+        }
+        if (b.contains("filter")) bg.filter = env_filter_by_name(b["filter"]);
+        if (b["type"] == "image" && b.contains("path")) {
+            if (load_images) load_envmap(bg, b["path"]);
+            else bg.path = b["path"];
+        }
+        if (b.contains("default")) {
+            auto d = b["default"];
+            bg.color = vec3{d[0], d[1], d[2]};
+        }
+    }
+
+    if (config.contains("animation")) scene.animation = parse_animation(config["animation"], scene.cam);
+
+    const nlohmann::json none = nlohmann::json::array();
+    for (auto& l : config.contains("lights") ? config["lights"] : none) {
+        scene.lights.push_back(vec3{l[0], l[1], l[2]});
+    }
+
+    for (auto& s : config.contains("spheres") ? config["spheres"] : none) {
+        vec3 center = {s["center"][0], s["center"][1], s["center"][2]};
+        float radius = s["radius"];
+        string mname = s["material"];
+        if (s.contains("keyframes") && !s["keyframes"].empty()) {
+            scene.animation.sphere_tracks.push_back(parse_sphere_track(uint32_t(scene.spheres.size()), s["keyframes"]));
+        }
+        vec3 velocity = {0, 0, 0};
+        if (s.contains("velocity")) velocity = vec3{s["velocity"][0], s["velocity"][1], s["velocity"][2]};
+        scene.spheres.emplace_back(center, radius, material_by_name(mname), velocity);
+    }
+    return scene;
+}
+
+// Load scene.json (or any other path) from disk
+inline Scene load_scene(const string& path, bool load_images = true) {
+    nlohmann::json config;
+    ifstream in(path);
+    in >> config;
+    return scene_from_json(config, load_images);
+}
+
+#endif
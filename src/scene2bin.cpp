@@ -0,0 +1,43 @@
+// Converter: scene.json -> binary .rtsb scene (see scene_bin.h)
+//
+// Build: g++ -std=c++17 -O2 -o scene2bin src/scene2bin.cpp
+// Usage: ./scene2bin scene.json scene.rtsb
+#include <iostream>
+#include <chrono>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "include/stb_image.h"
+
+#include "scene.h"
+#include "scene_bin.h"
+
+using namespace std;
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        cerr << "Usage: " << argv[0] << " <scene.json> <out.rtsb>\n";
+        return 1;
+    }
+    auto t0 = chrono::high_resolution_clock::now();
+    Scene scene;
+    try {
+        scene = load_scene(argv[1], false);   // only the envmap path is stored
+    } catch (const exception& e) {
+        cerr << "Failed to parse " << argv[1] << ": " << e.what() << "\n";
+        return 1;
+    }
+    auto t1 = chrono::high_resolution_clock::now();
+    // .rtsb has no animation or crop section, a silent conversion would drop them
+    if (scene.animation.enabled() || scene.crop.enabled()) {
+        cerr << argv[1] << ": \"" << (scene.animation.enabled() ? "animation" : "crop")
+             << "\" cannot be stored in .rtsb, render the JSON scene directly\n";
+        return 1;
+    }
+    if (!save_scene_bin(argv[2], scene)) {
+        cerr << "Failed to write " << argv[2] << "\n";
+        return 1;
+    }
+    cout << "Loaded " << scene.spheres.size() << " spheres, " << scene.lights.size() << " lights in "
+         << chrono::duration_cast<chrono::milliseconds>(t1 - t0).count() << " ms, wrote " << argv[2] << endl;
+    return 0;
+}
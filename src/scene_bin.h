@@ -0,0 +1,200 @@
+// Description: Compact binary scene format (.rtsb) and its memory mapped loader.
+//              Written by the scene2bin tool, so big scenes skip JSON parsing.
+//
+// Layout (little endian, every section 8-byte aligned):
+//   SceneBinHeader | Material[num_materials] | vec3[num_lights]
+//   | SphereRecord[num_spheres] | envmap path (bg_path_len bytes)
+#ifndef SCENE_BIN_H
+#define SCENE_BIN_H
+
+#include "scene.h"
+#include "mapped_file.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+using namespace std;
+
+constexpr char     SCENE_BIN_MAGIC[4] = {'R', 'T', 'S', 'B'};
+constexpr uint32_t SCENE_BIN_VERSION  = 6;
+
+struct SceneBinHeader {
+    char     magic[4];
+    uint32_t version;
+    int32_t  width, height;
+
+    // Camera basis is stored as is, so the loaded camera matches bit for bit
+    vec3     cam_position, cam_right, cam_up, cam_forward;
+    float    cam_fov, cam_aperture, cam_focus_dist;
+    uint32_t cam_seed;
+    float    cam_shutter_open, cam_shutter_close;
+    int32_t  spp;
+    uint32_t sampler;       // SamplerType
+    uint32_t jitter;
+    uint32_t fresnel;       // FresnelModel
+    uint32_t fresnel_split;
+
+    vec3     bg_color;
+    uint32_t bg_path_len;
+    int32_t  bg_ibl_samples;
+    float    bg_ibl_intensity;
+    uint32_t bg_filter;     // EnvFilter
+
+    uint32_t num_materials, num_lights, num_spheres;
+    uint64_t materials_offset, lights_offset, spheres_offset, bg_path_offset;
+};
+
+struct SphereRecord {
+    vec3     center;
+    float    radius;
+    uint32_t material;      // index into the material table
+    vec3     velocity;
+};
+
+static_assert(is_trivially_copyable_v<Material>, "Material is written as raw bytes");
+static_assert(sizeof(vec3) == 3 * sizeof(float), "vec3 is written as raw bytes");
+
+inline uint64_t scene_bin_align(uint64_t offset) { return (offset + 7) & ~uint64_t(7); }
+
+// True if the file starts with the .rtsb magic
+inline bool is_scene_bin(const string& path) {
+    ifstream in(path, ios::binary);
+    char magic[4] = {};
+    in.read(magic, 4);
+    return in && memcmp(magic, SCENE_BIN_MAGIC, 4) == 0;
+}
+
+inline bool save_scene_bin(const string& path, const Scene& scene) {
+    // Spheres share a handful of materials, store each distinct one once
+    vector<Material> materials;
+    vector<SphereRecord> records;
+    records.reserve(scene.spheres.size());
+    for (const Sphere& s : scene.spheres) {
+        uint32_t idx = 0;
+        while (idx < materials.size() && memcmp(&materials[idx], &s.material, sizeof(Material)) != 0) ++idx;
+        if (idx == materials.size()) materials.push_back(s.material);
+        records.push_back({s.center, s.radius, idx, s.velocity});
+    }
+
+    SceneBinHeader h;
+    memset(static_cast<void*>(&h), 0, sizeof(h));   // zero the padding too, files stay byte-identical
+    memcpy(h.magic, SCENE_BIN_MAGIC, 4);
+    h.version        = SCENE_BIN_VERSION;
+    h.width          = scene.width;
+    h.height         = scene.height;
+    h.cam_position   = scene.cam.position;
+    h.cam_right      = scene.cam.right;
+    h.cam_up         = scene.cam.up;
+    h.cam_forward    = scene.cam.forward;
+    h.cam_fov        = scene.cam.fov;
+    h.cam_aperture   = scene.cam.aperture;
+    h.cam_focus_dist = scene.cam.focus_dist;
+    h.cam_seed       = scene.cam.seed;
+    h.cam_shutter_open  = scene.cam.shutter_open;
+    h.cam_shutter_close = scene.cam.shutter_close;
+    h.spp            = scene.spp;
+    h.sampler        = uint32_t(scene.sampler);
+    h.jitter         = scene.jitter;
+    h.fresnel        = uint32_t(scene.fresnel);
+    h.fresnel_split  = scene.fresnel_split;
+    h.bg_color       = scene.bg.color;
+    h.bg_path_len    = uint32_t(scene.bg.path.size());
+    h.bg_ibl_samples   = scene.bg.ibl_samples;
+    h.bg_ibl_intensity = scene.bg.ibl_intensity;
+    h.bg_filter        = uint32_t(scene.bg.filter);
+    h.num_materials  = uint32_t(materials.size());
+    h.num_lights     = uint32_t(scene.lights.size());
+    h.num_spheres    = uint32_t(records.size());
+    h.materials_offset = scene_bin_align(sizeof(SceneBinHeader));
+    h.lights_offset    = scene_bin_align(h.materials_offset + materials.size() * sizeof(Material));
+    h.spheres_offset   = scene_bin_align(h.lights_offset + scene.lights.size() * sizeof(vec3));
+    h.bg_path_offset   = scene_bin_align(h.spheres_offset + records.size() * sizeof(SphereRecord));
+
+    ofstream out(path, ios::binary);
+    auto write_at = [&](uint64_t offset, const void* data, size_t bytes) {
+        static const char zeros[8] = {};
+        uint64_t pos = uint64_t(out.tellp());
+        out.write(zeros, streamsize(offset - pos));     // padding up to the section start
+        out.write(static_cast<const char*>(data), streamsize(bytes));
+    };
+    write_at(0, &h, sizeof(h));
+    write_at(h.materials_offset, materials.data(), materials.size() * sizeof(Material));
+    write_at(h.lights_offset, scene.lights.data(), scene.lights.size() * sizeof(vec3));
+    write_at(h.spheres_offset, records.data(), records.size() * sizeof(SphereRecord));
+    write_at(h.bg_path_offset, scene.bg.path.data(), scene.bg.path.size());
+    return bool(out);
+}
+
+// Map the file and build the Scene straight from the mapped records.
+// Throws runtime_error on a malformed file.
+inline Scene load_scene_bin(const string& path, bool load_images = true) {
+    MappedFile file(path);
+    if (!file.is_open()) throw runtime_error("cannot open " + path);
+    if (file.size() < sizeof(SceneBinHeader)) throw runtime_error(path + ": truncated header");
+
+    SceneBinHeader h;
+    memcpy(&h, file.data(), sizeof(h));
+    if (memcmp(h.magic, SCENE_BIN_MAGIC, 4) != 0) throw runtime_error(path + ": not a .rtsb scene");
+    if (h.version != SCENE_BIN_VERSION) throw runtime_error(path + ": unsupported .rtsb version, convert it again with scene2bin");
+
+    auto section = [&](uint64_t offset, uint64_t count, size_t elem) {
+        if (offset > file.size() || count * elem > file.size() - offset) {
+            throw runtime_error(path + ": section out of range");
+        }
+        return file.data() + offset;
+    };
+    const Material*     materials = reinterpret_cast<const Material*>(section(h.materials_offset, h.num_materials, sizeof(Material)));
+    const vec3*         lights    = reinterpret_cast<const vec3*>(section(h.lights_offset, h.num_lights, sizeof(vec3)));
+    const SphereRecord* records   = reinterpret_cast<const SphereRecord*>(section(h.spheres_offset, h.num_spheres, sizeof(SphereRecord)));
+    const char*         bg_path   = section(h.bg_path_offset, h.bg_path_len, 1);
+
+    Scene scene;
+    scene.width  = h.width;
+    scene.height = h.height;
+    scene.spp    = max(1, int(h.spp));
+    if (h.sampler > uint32_t(SamplerType::BlueNoise)) throw runtime_error(path + ": bad sampler");
+    scene.sampler = SamplerType(h.sampler);
+    scene.jitter = h.jitter != 0;
+    if (h.fresnel > uint32_t(FresnelModel::Exact)) throw runtime_error(path + ": bad fresnel model");
+    scene.fresnel = FresnelModel(h.fresnel);
+    scene.fresnel_split = h.fresnel_split != 0;
+
+    Camera& cam = scene.cam;
+    cam.position   = h.cam_position;
+    cam.right      = h.cam_right;
+    cam.up         = h.cam_up;
+    cam.forward    = h.cam_forward;
+    cam.fov        = h.cam_fov;
+    cam.aperture   = h.cam_aperture;
+    cam.focus_dist = h.cam_focus_dist;
+    cam.seed       = h.cam_seed;
+    cam.shutter_open  = h.cam_shutter_open;
+    cam.shutter_close = h.cam_shutter_close;
+
+    scene.lights.assign(lights, lights + h.num_lights);
+
+    scene.spheres.reserve(h.num_spheres);
+    for (uint32_t i = 0; i < h.num_spheres; ++i) {
+        const SphereRecord& r = records[i];
+        if (r.material >= h.num_materials) throw runtime_error(path + ": bad material index");
+        scene.spheres.emplace_back(r.center, r.radius, materials[r.material], r.velocity);
+    }
+
+    scene.bg.color = h.bg_color;
+    scene.bg.path = string(bg_path, h.bg_path_len);
+    scene.bg.ibl_samples = max(0, int(h.bg_ibl_samples));
+    scene.bg.ibl_intensity = h.bg_ibl_intensity;
+    if (h.bg_filter > uint32_t(EnvFilter::Cone)) throw runtime_error(path + ": bad envmap filter");
+    scene.bg.filter = EnvFilter(h.bg_filter);
+    if (load_images && !scene.bg.path.empty()) load_envmap(scene.bg, scene.bg.path);
+    return scene;
+}
+
+// Pick the loader from the file content: .rtsb magic or JSON
+inline Scene load_scene_file(const string& path) {
+    return is_scene_bin(path) ? load_scene_bin(path) : load_scene(path);
+}
+
+#endif
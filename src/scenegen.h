@@ -0,0 +1,60 @@
+// Description: Procedural scene generator used by the benchmark tools.
+//              Produces reproducible random sphere fields for a given seed.
+#ifndef SCENEGEN_H
+#define SCENEGEN_H
+
+#include "scene.h"
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct SceneGenParams {
+    int num_spheres = 64;
+    int num_lights  = 4;
+    string mix      = "mixed";   // "diffuse", "mixed" or "glass"
+    bool dof        = false;     // enable depth of field on the camera
+    int width       = 320;
+    int height      = 240;
+    uint32_t seed   = 1;
+};
+
+// Materials used by each mix, "glass" is recursion heavy (reflect + refract everywhere)
+inline vector<Material> material_mix(const string& mix) {
+    if (mix == "diffuse") return {ivory, red_rubber};
+    if (mix == "glass")   return {glass, ice, emerald, mirror};
+    return {ivory, glass, mirror, red_rubber, gold, emerald, steel, ice};
+}
+
+// Fill the box above the checkerboard floor with random spheres.
+// Only uses mt19937 bits (not std distributions) so the scene is identical on every platform.
+inline Scene generate_scene(const SceneGenParams& p) {
+    mt19937 rng(p.seed);
+    auto uniform = [&](float lo, float hi) {
+        return lo + (hi - lo) * ((rng() >> 8) * (1.f / 16777216.f));
+    };
+
+    Scene scene;
+    scene.width  = p.width;
+    scene.height = p.height;
+    scene.cam    = Camera(vec3{0, 0, 0}, vec3{0, 0, -1}, 1.05f, p.dof ? 0.2f : 0.0f, 20.0f);
+    scene.cam.seed = p.seed;
+    scene.bg.color = vec3{0.2f, 0.7f, 0.8f};
+
+    for (int i = 0; i < p.num_lights; ++i) {
+        scene.lights.push_back(vec3{uniform(-40, 40), uniform(20, 100), uniform(-40, 30)});
+    }
+
+    // Keep the total sphere volume roughly constant so dense scenes stay readable
+    vector<Material> mats = material_mix(p.mix);
+    float max_r = 2.5f / cbrt(max(1.f, p.num_spheres / 12.f));
+    for (int i = 0; i < p.num_spheres; ++i) {
+        vec3 center = {uniform(-10, 10), uniform(-3, 6), uniform(-30, -10)};
+        float radius = uniform(0.3f, 1.f) * max_r;
+        scene.spheres.emplace_back(center, radius, mats[rng() % mats.size()]);
+    }
+    return scene;
+}
+
+#endif
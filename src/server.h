@@ -0,0 +1,337 @@
+// Description: Render server. Listens on a Unix domain socket or a TCP port and keeps
+//              parsed scenes, envmaps and BVHs in memory between jobs, so a job only
+//              pays for the trace itself. The TCP mode is the worker side of
+//              distributed tile rendering (see distributed.h).
+//
+// Protocol, jobs are served in order until the client closes the connection:
+//   client -> {"scene": "scene.json", "diff": {..}, "camera": {..}, "width": 640,
+//              "height": 480, "spp": 4, "depth": 4, "tile": [x0, y0, x1, y1],
+//              "format": "png"} + '\n'
+//   server -> {"ok": true, "bytes": N, ...} + '\n' + N bytes of encoded image
+//             {"ok": false, "error": "..."} + '\n' on failure
+// "diff" is a JSON merge patch (RFC 7386) applied to the scene file before building.
+// "camera" uses the scene.json camera keys and only overrides the values it contains.
+// "tile" renders only that rectangle of the width x height frame.
+// "format" is png, ppm or rgb32f (raw host-order floats, 3 per pixel).
+// {"shutdown": true} stops the server.
+#ifndef SERVER_H
+#define SERVER_H
+
+#ifndef _WIN32
+
+#include "scene.h"
+#include "scene_bin.h"
+#include "render.h"
+#include "image.h"
+#include "net.h"
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+class RenderServer {
+public:
+    size_t max_scenes = 8;      // built scenes kept resident (LRU)
+
+    // Serve jobs until a shutdown request arrives. Returns a process exit code.
+    int run(const string& socket_path) {
+        int listen_fd = unix_listen(socket_path);
+        if (listen_fd < 0) {
+            if (errno == EEXIST) cerr << socket_path << " exists and is not a socket, not replacing it\n";
+            else cerr << "Cannot listen on " << socket_path << ": " << strerror(errno) << "\n";
+            return 1;
+        }
+        cout << "Render server listening on " << socket_path << endl;
+        serve(listen_fd);
+        unlink(socket_path.c_str());
+        return 0;
+    }
+
+    // Same on TCP, "host:port" or "port" (loopback only, other interfaces need an explicit host)
+    int run_tcp(const string& address) {
+        string host;
+        int port;
+        if (!parse_host_port(address, host, port)) {
+            cerr << "Bad worker address " << address << ", expected [host:]port\n";
+            return 1;
+        }
+        int listen_fd = tcp_listen(host, port);
+        if (listen_fd < 0) {
+            cerr << "Cannot listen on " << address << ": " << strerror(errno) << "\n";
+            return 1;
+        }
+        cout << "Render server listening on " << host << ":" << socket_port(listen_fd) << endl;
+        serve(listen_fd);
+        return 0;
+    }
+
+    // Accept loop on an already listening socket (also used for workers spawned with an inherited socket).
+    // One connection is served at a time.
+    void serve(int listen_fd) {
+        bool running = true;
+        while (running) {
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                break;
+            }
+            set_nodelay(fd);
+            SocketReader reader(fd);
+            string line;
+            while (running && reader.read_line(line)) running = handle(fd, line);
+            close(fd);
+        }
+        close(listen_fd);
+    }
+
+private:
+    struct SceneFile {                  // parsed scene.json, re-read when the file changes
+        filesystem::file_time_type mtime;
+        uintmax_t size = 0;
+        nlohmann::json config;
+    };
+    struct EnvImage {                   // decoded envmap, re-read when the file changes
+        filesystem::file_time_type mtime;
+        uintmax_t size = 0;
+        unsigned char* data = nullptr;
+        shared_ptr<TiledTexture> tiled;             // .rttx envmaps
+        int width = 0, height = 0, channels = 0;
+        shared_ptr<const EnvDistribution> ibl;      // built the first time a scene lights with it
+        shared_ptr<const vector<EnvMipLevel>> mips; // built the first time a scene filters with cones
+
+        EnvImage() = default;
+        EnvImage(const EnvImage&) = delete;
+        EnvImage& operator=(const EnvImage&) = delete;
+        ~EnvImage() { if (data) stbi_image_free(data); }
+    };
+    struct SceneEntry {                 // built scene + its values before job overrides
+        Scene scene;
+        Camera base_cam;
+        int width = 0, height = 0, spp = 1;
+        bool bvh_cached = false;
+        list<uint64_t>::iterator lru_pos;
+        shared_ptr<EnvImage> env;       // keeps the envmap alive after a newer version replaced it
+    };
+
+    unordered_map<string, SceneFile> files_;
+    unordered_map<uint64_t, unique_ptr<SceneEntry>> scenes_;
+    list<uint64_t> lru_;                // front = most recently used
+    unordered_map<string, shared_ptr<EnvImage>> envmaps_;     // newest version per path
+
+    // Returns false when the server should stop
+    bool handle(int fd, const string& line) {
+        nlohmann::json req, reply;
+        vector<unsigned char> image;
+        try {
+            req = nlohmann::json::parse(line);
+            if (req.value("shutdown", false)) {
+                write_line(fd, nlohmann::json{{"ok", true}}.dump());
+                return false;
+            }
+            reply = render_job(req, image);
+        } catch (const exception& e) {
+            reply = {{"ok", false}, {"error", e.what()}};
+            image.clear();
+        }
+        write_line(fd, reply.dump());
+        if (!image.empty()) write_all(fd, image.data(), image.size());
+        return true;
+    }
+
+    const SceneFile& scene_file(const string& path) {
+        auto mtime = filesystem::last_write_time(path);
+        auto size = filesystem::file_size(path);
+        SceneFile& f = files_[path];
+        if (f.config.is_null() || f.mtime != mtime || f.size != size) {
+            ifstream in(path);
+            f.config = nlohmann::json::parse(in);
+            f.mtime = mtime;
+            f.size = size;
+        }
+        return f;
+    }
+
+    // The envmap at 'path', decoded again once the file's modification time or size changed
+    shared_ptr<EnvImage> envmap(const string& path) {
+        error_code ec;
+        auto mtime = filesystem::last_write_time(path, ec);
+        uintmax_t size = ec ? 0 : filesystem::file_size(path, ec);
+        shared_ptr<EnvImage>& env = envmaps_[path];
+        if (env && env->mtime == mtime && env->size == size) return env;
+
+        env = make_shared<EnvImage>();
+        env->mtime = mtime;
+        env->size = size;
+        if (is_tiled_texture(path)) {
+            Background tiled;               // tiles are paged in by the texture cache
+            if (open_tiled_envmap(tiled, path)) env->tiled = tiled.tiled;
+        } else {
+            env->data = stbi_load(path.c_str(), &env->width, &env->height, &env->channels, 0);
+            if (!env->data) cerr << "Failed to load envmap " << path << ", fallback to color.\n";
+        }
+        return env;
+    }
+
+    void attach_envmap(SceneEntry& entry) {
+        Background& bg = entry.scene.bg;
+        if (bg.path.empty()) return;
+        entry.env = envmap(bg.path);
+        EnvImage& env = *entry.env;
+        bg.image_data = env.data;
+        bg.tiled = env.tiled;
+        bg.width = bg.tiled ? bg.tiled->width() : env.width;
+        bg.height = bg.tiled ? bg.tiled->height() : env.height;
+        bg.channels = bg.tiled ? 3 : env.channels;
+        bg.ibl = nullptr;
+        bg.mips = nullptr;
+        if (bg.ibl_samples > 0) {
+            if (!env.ibl) env.ibl = build_env_distribution(bg);
+            bg.ibl = env.ibl;
+        }
+        if (bg.filter == EnvFilter::Cone && !bg.tiled) {
+            if (!env.mips) env.mips = build_env_mips(bg);
+            bg.mips = env.mips;
+        }
+    }
+
+    // Find or build the scene for (path, diff). The key is the file's path, modification time
+    // and size plus the diff text, so a cached scene costs a stat and a hash of the diff only.
+    SceneEntry& scene_entry(const string& path, const nlohmann::json& diff, bool& was_cached) {
+        string abs_path = filesystem::absolute(path).lexically_normal().string();
+        bool binary = is_scene_bin(abs_path);
+        if (binary && !diff.is_null()) throw runtime_error("\"diff\" is only supported for JSON scenes");
+        const SceneFile* file = nullptr;
+        int64_t stamp[2];
+        if (binary) {
+            stamp[0] = int64_t(filesystem::last_write_time(abs_path).time_since_epoch().count());
+            stamp[1] = int64_t(filesystem::file_size(abs_path));
+        } else {
+            file = &scene_file(abs_path);       // parsed again only when the file changed
+            stamp[0] = int64_t(file->mtime.time_since_epoch().count());
+            stamp[1] = int64_t(file->size);
+        }
+        uint64_t key = fnv1a64(abs_path.data(), abs_path.size());
+        key = fnv1a64(stamp, sizeof(stamp), key);
+        if (!diff.is_null()) {
+            string diff_text = diff.dump();
+            key = fnv1a64(diff_text.data(), diff_text.size(), key);
+        }
+
+        auto it = scenes_.find(key);
+        was_cached = it != scenes_.end();
+        if (was_cached) {
+            SceneEntry& entry = *it->second;
+            lru_.splice(lru_.begin(), lru_, entry.lru_pos);
+            if (!entry.scene.bg.path.empty() && envmap(entry.scene.bg.path) != entry.env) attach_envmap(entry);
+            return entry;
+        }
+
+        auto entry = make_unique<SceneEntry>();
+        if (binary) {
+            entry->scene = load_scene_bin(abs_path, false);
+        } else if (diff.is_null()) {
+            entry->scene = scene_from_json(file->config, false);
+        } else {
+            nlohmann::json config = file->config;
+            config.merge_patch(diff);
+            entry->scene = scene_from_json(config, false);
+        }
+        // envmaps are decoded once per file version and shared between scenes
+        attach_envmap(*entry);
+        entry->bvh_cached = prepare_bvh(entry->scene, "cache");
+        entry->base_cam = entry->scene.cam;
+        entry->width = entry->scene.width;
+        entry->height = entry->scene.height;
+        entry->spp = entry->scene.spp;
+
+        if (scenes_.size() >= max_scenes) {
+            scenes_.erase(lru_.back());
+            lru_.pop_back();
+        }
+        lru_.push_front(key);
+        entry->lru_pos = lru_.begin();
+        return *scenes_.emplace(key, std::move(entry)).first->second;
+    }
+
+    nlohmann::json render_job(const nlohmann::json& req, vector<unsigned char>& image) {
+        auto t0 = chrono::high_resolution_clock::now();
+        bool scene_cached;
+        SceneEntry& entry = scene_entry(req.value("scene", string("scene.json")),
+                                        req.contains("diff") ? req["diff"] : nlohmann::json(), scene_cached);
+        auto t1 = chrono::high_resolution_clock::now();
+
+        // Per job overrides on top of the cached scene
+        Scene& scene = entry.scene;
+        scene.cam    = req.contains("camera") ? camera_from_json(req["camera"], entry.base_cam) : entry.base_cam;
+        scene.width  = req.value("width", entry.width);
+        scene.height = req.value("height", entry.height);
+        scene.spp    = max(1, req.value("spp", entry.spp));
+        if (scene.width <= 0 || scene.height <= 0 || int64_t(scene.width) * scene.height > (1LL << 28)) {
+            throw runtime_error("bad resolution");
+        }
+        if (scene.spp > 65536) throw runtime_error("bad spp");
+        // The motion tree bounds the spheres over one shutter interval, a job that moves
+        // the shutter needs new end bounds (the next job with the base shutter sets them back)
+        if (scene.bvh.end_bounds && (scene.cam.shutter_open != scene.bvh.shutter_open ||
+                                     scene.cam.shutter_close != scene.bvh.shutter_close)) {
+            set_bvh_motion(scene.bvh, scene.spheres, scene.cam.shutter_open, scene.cam.shutter_close);
+        }
+
+        // Whole frame, or only the tile [x0, x1) x [y0, y1) of it
+        int x0 = 0, y0 = 0, x1 = scene.width, y1 = scene.height;
+        if (req.contains("tile")) {
+            const auto& t = req["tile"];
+            if (!t.is_array() || t.size() != 4) throw runtime_error("\"tile\" must be [x0, y0, x1, y1]");
+            x0 = t[0]; y0 = t[1]; x1 = t[2]; y1 = t[3];
+            if (x0 < 0 || y0 < 0 || x1 > scene.width || y1 > scene.height || x0 >= x1 || y0 >= y1) {
+                throw runtime_error("tile outside the frame");
+            }
+        }
+        const int out_w = x1 - x0, out_h = y1 - y0;
+
+        int saved_depth = depthMax;
+        depthMax = req.value("depth", depthMax);
+        if (depthMax < 0 || depthMax > 100) { depthMax = saved_depth; throw runtime_error("bad depth"); }
+        string format = req.value("format", string("png"));
+        if (format != "png" && format != "ppm" && format != "rgb32f") {
+            depthMax = saved_depth;
+            throw runtime_error("unknown format " + format);
+        }
+
+        vector<vec3> framebuffer;
+        if (req.contains("tile")) {
+            render_tile(scene, x0, y0, x1, y1, framebuffer);
+        } else {
+            framebuffer.resize(size_t(scene.width) * scene.height);
+            render(scene, framebuffer);
+        }
+        depthMax = saved_depth;
+        auto t2 = chrono::high_resolution_clock::now();
+
+        if (format == "ppm") image = encode_ppm(out_w, out_h, framebuffer);
+        else if (format == "png") image = encode_png(out_w, out_h, framebuffer);
+        else {
+            static_assert(sizeof(vec3) == 3 * sizeof(float), "vec3 must be 3 packed floats");
+            const unsigned char* raw = reinterpret_cast<const unsigned char*>(framebuffer.data());
+            image.assign(raw, raw + framebuffer.size() * sizeof(vec3));
+        }
+        auto t3 = chrono::high_resolution_clock::now();
+
+        auto ms = [](auto a, auto b) { return chrono::duration<double, milli>(b - a).count(); };
+        return {
+            {"ok", true}, {"format", format}, {"bytes", image.size()},
+            {"width", out_w}, {"height", out_h},
+            {"scene_cached", scene_cached}, {"bvh_cached", entry.bvh_cached},
+            {"setup_ms", ms(t0, t1)}, {"render_ms", ms(t1, t2)}, {"encode_ms", ms(t2, t3)}
+        };
+    }
+};
+
+#endif // _WIN32
+
+#endif
@@ -4,6 +4,8 @@
 
 #include "vec3.h"
 #include "material.h"
+#include <algorithm>
+#include <cmath>
 #include <tuple>
 
 // We only need a center point and Radius to discribe a sphere.
@@ -11,9 +13,13 @@ struct Sphere {
     vec3 center;
     float radius;
     Material material;
+    vec3 velocity = {0, 0, 0};   // linear motion per unit of shutter time (motion blur)
 
-    Sphere(const vec3& c, float r, const Material& m)
-    : center(c), radius(r), material(m) {}
+    Sphere(const vec3& c, float r, const Material& m, const vec3& v = {0, 0, 0})
+    : center(c), radius(r), material(m), velocity(v) {}
+
+    // Center at shutter time t
+    vec3 center_at(float t) const { return center + velocity * t; }
 };
 
 // Check if a ray intersects with a sphere
@@ -21,24 +27,46 @@ struct Sphere {
 //       dir     = ray direction（normalized）
 //       s       =  target sphere
 // Return value: tuple<intersection found, hit distance>
-inline std::tuple<bool, float> ray_sphere_intersect(const vec3& orig, const vec3& dir, const Sphere& s) {
-    vec3 o2s = s.center - orig;           // cam -> sphere center
+// Any hit in front of the origin counts (t > 0). Secondary rays start off the surface (see
+// offset_ray_origin in render.h), so the sphere they leave is not hit again. Both roots are
+// computed without cancellation (Ray Tracing Gems ch. 7), so that also holds at large scales.
+inline std::tuple<bool, float> ray_sphere_intersect(const vec3& orig, const vec3& dir, const vec3& center, float radius) {
+    vec3 o2s = center - orig;             // cam -> sphere center
     float tca = o2s * dir;                // t (closest approach), Projected length on the ray
-    float d2 = o2s * o2s - tca * tca;     // 最近点到球心的距离平方 / Closest distance squared
-    float r2 = s.radius * s.radius;       // Squaring is much faster than computing sqrt
+    float r2 = radius * radius;           // Squaring is much faster than computing sqrt
+    float o2s2 = o2s * o2s;
 
-
-    if (d2 > r2) return {false, 0};       // No intersection
+    // 最近点到球心的距离平方 / Closest distance squared. The quick difference loses the low
+    // bits when the sphere is far away: it only rejects clear misses, the rest recompute it
+    // from the closest point itself.
+    float d2 = o2s2 - tca * tca;
+    if (d2 - r2 > 1e-6f * o2s2) return {false, 0};        // No intersection
+    vec3 l = o2s - dir * tca;             // 最近点到球心 / Closest point -> center
+    d2 = l * l;
+    if (d2 > r2) return {false, 0};
 
     //if intersect, than check the position 
     float thc = std::sqrt(r2 - d2);       // 半弦长,从射线最近点到球体表面交点之间的距离 / Half chord 
-    float t0 = tca - thc;
-    float t1 = tca + thc;
+    // The roots multiply to c = |o2s|^2 - r^2 (> 0: origin outside). q is the one where tca
+    // and thc add up, the other one is c / q: neither cancels.
+    float q = tca + std::copysign(thc, tca);
+    float c = o2s2 - r2;
+    float t0 = std::min(q, c / q);
+    float t1 = std::max(q, c / q);
 
     // 返回最近的正交点 / Return the nearest valid intersection
-    if (t0 > 0.001f) return {true, t0};
-    if (t1 > 0.001f) return {true, t1};
+    if (t0 > 0) return {true, t0};
+    if (t1 > 0) return {true, t1};
     return {false, 0};
 }
 
+inline std::tuple<bool, float> ray_sphere_intersect(const vec3& orig, const vec3& dir, const Sphere& s) {
+    return ray_sphere_intersect(orig, dir, s.center, s.radius);
+}
+
+// Moving sphere, tested where it is at the ray's time
+inline std::tuple<bool, float> ray_sphere_intersect(const vec3& orig, const vec3& dir, const Sphere& s, float time) {
+    return ray_sphere_intersect(orig, dir, s.center_at(time), s.radius);
+}
+
 #endif 
@@ -0,0 +1,123 @@
+// Converter: image (.jpg / .png / ...) -> tiled, mipmapped texture (.rttx, see texture_cache.h)
+//
+// Build: g++ -std=c++17 -O2 -o texconvert src/texconvert.cpp
+// Usage: ./texconvert assets/envmap.jpg assets/envmap.rttx [--tile 64]
+#include <iostream>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "include/stb_image_write.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "include/stb_image.h"
+
+#include "texture_cache.h"
+
+using namespace std;
+
+int main(int argc, char* argv[]) {
+    vector<string> files;
+    int tile_size = 64;
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        if (a == "--tile" && i + 1 < argc) tile_size = atoi(argv[++i]);
+        else files.push_back(a);
+    }
+    if (files.size() != 2 || tile_size < 8 || tile_size > 1024) {
+        cerr << "Usage: " << argv[0] << " <in.jpg|png> <out.rttx> [--tile 8..1024]\n";
+        return 1;
+    }
+    auto t0 = chrono::high_resolution_clock::now();
+
+    int width, height, channels;
+    unsigned char* data = stbi_load(files[0].c_str(), &width, &height, &channels, 3);
+    if (!data) {
+        cerr << "Failed to read " << files[0] << "\n";
+        return 1;
+    }
+
+    // Mip levels, down to 1 pixel high like the in-memory envmap pyramid
+    struct Level { int width, height; vector<unsigned char> rgb; };
+    vector<Level> levels;
+    levels.push_back({width, height, vector<unsigned char>(data, data + size_t(width) * height * 3)});
+    stbi_image_free(data);
+    while (levels.back().height > 1) {
+        const Level& prev = levels.back();
+        Level next;
+        next.rgb = downsample_rgb8(prev.rgb.data(), prev.width, prev.height, next.width, next.height);
+        levels.push_back(move(next));
+    }
+
+    TiledTextureHeader h;
+    memset(static_cast<void*>(&h), 0, sizeof(h));
+    memcpy(h.magic, TILED_TEXTURE_MAGIC, 4);
+    h.version = TILED_TEXTURE_VERSION;
+    h.width = width;
+    h.height = height;
+    h.tile_size = uint32_t(tile_size);
+    h.num_levels = uint32_t(levels.size());
+
+    vector<TiledTextureLevel> level_table(levels.size());
+    for (size_t l = 0; l < levels.size(); ++l) {
+        TiledTextureLevel& t = level_table[l];
+        memset(static_cast<void*>(&t), 0, sizeof(t));
+        t.width = levels[l].width;
+        t.height = levels[l].height;
+        t.tiles_x = uint32_t((t.width + tile_size - 1) / tile_size);
+        t.tiles_y = uint32_t((t.height + tile_size - 1) / tile_size);
+        t.first_tile = h.num_tiles;
+        h.num_tiles += t.tiles_x * t.tiles_y;
+    }
+
+    // Compress every tile, edge tiles repeat the last row / column
+    vector<vector<unsigned char>> packed(h.num_tiles);
+    size_t raw_bytes = 0;
+    for (size_t l = 0; l < levels.size(); ++l) {
+        const Level& lv = levels[l];
+        const TiledTextureLevel& t = level_table[l];
+        for (uint32_t ty = 0; ty < t.tiles_y; ++ty) {
+            for (uint32_t tx = 0; tx < t.tiles_x; ++tx) {
+                vector<unsigned char> raw(size_t(tile_size) * tile_size * 3);
+                for (int y = 0; y < tile_size; ++y) {
+                    int sy = min(int(ty) * tile_size + y, lv.height - 1);
+                    for (int x = 0; x < tile_size; ++x) {
+                        int sx = min(int(tx) * tile_size + x, lv.width - 1);
+                        memcpy(&raw[(size_t(y) * tile_size + x) * 3], &lv.rgb[(size_t(sy) * lv.width + sx) * 3], 3);
+                    }
+                }
+                int len = 0;
+                unsigned char* z = stbi_zlib_compress(raw.data(), int(raw.size()), &len, 6);
+                packed[t.first_tile + ty * t.tiles_x + tx].assign(z, z + len);
+                STBIW_FREE(z);
+                raw_bytes += raw.size();
+            }
+        }
+    }
+
+    vector<TiledTextureTile> tile_table(h.num_tiles);
+    uint64_t offset = sizeof(h) + level_table.size() * sizeof(TiledTextureLevel) + tile_table.size() * sizeof(TiledTextureTile);
+    for (uint32_t i = 0; i < h.num_tiles; ++i) {
+        memset(static_cast<void*>(&tile_table[i]), 0, sizeof(TiledTextureTile));
+        tile_table[i].offset = offset;
+        tile_table[i].size = uint32_t(packed[i].size());
+        offset += packed[i].size();
+    }
+
+    ofstream out(files[1], ios::binary);
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    out.write(reinterpret_cast<const char*>(level_table.data()), streamsize(level_table.size() * sizeof(TiledTextureLevel)));
+    out.write(reinterpret_cast<const char*>(tile_table.data()), streamsize(tile_table.size() * sizeof(TiledTextureTile)));
+    for (const auto& p : packed) out.write(reinterpret_cast<const char*>(p.data()), streamsize(p.size()));
+    if (!out) {
+        cerr << "Failed to write " << files[1] << "\n";
+        return 1;
+    }
+    auto t1 = chrono::high_resolution_clock::now();
+    cout << "Wrote " << files[1] << ": " << width << "x" << height << ", " << levels.size() << " levels, "
+         << h.num_tiles << " tiles of " << tile_size << "x" << tile_size << ", " << (offset >> 20) << " MB ("
+         << (raw_bytes >> 20) << " MB inflated) in "
+         << chrono::duration_cast<chrono::milliseconds>(t1 - t0).count() << " ms" << endl;
+    return 0;
+}
@@ -0,0 +1,287 @@
+// Description: Tiled, mipmapped textures (.rttx) read through a shared tile cache.
+//              The texconvert tool writes them once. A file holds every mip level cut into
+//              square RGB8 tiles, each zlib-compressed on its own. The file is memory mapped
+//              and a tile is only inflated the first time it is read. Inflated tiles share one
+//              memory budget and the least recently used ones are dropped first, so textures
+//              larger than RAM still render. Each thread keeps a small table of the tiles it
+//              used last, so most reads take no lock. Those tables are outside the budget:
+//              resident tiles are bounded by the budget plus LOCAL_SLOTS tiles per thread.
+//
+// Layout (little endian, offsets from the start of the file):
+//   TiledTextureHeader | TiledTextureLevel[num_levels] | TiledTextureTile[num_tiles]
+//   | compressed tiles
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "vec3.h"
+#include "mapped_file.h"
+#ifndef STBI_INCLUDE_STB_IMAGE_H   // the .cpp may already have pulled in the implementation
+#include "include/stb_image.h"
+#endif
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+constexpr char     TILED_TEXTURE_MAGIC[4] = {'R', 'T', 'T', 'X'};
+constexpr uint32_t TILED_TEXTURE_VERSION  = 1;
+
+struct TiledTextureHeader {
+    char     magic[4];
+    uint32_t version;
+    int32_t  width, height;         // level 0
+    uint32_t tile_size;             // tiles are tile_size x tile_size RGB8, edge tiles padded
+    uint32_t num_levels, num_tiles;
+    uint32_t reserved;
+};
+
+struct TiledTextureLevel {
+    int32_t  width, height;
+    uint32_t tiles_x, tiles_y;
+    uint32_t first_tile;            // index of the level's top-left tile, rows of tiles follow
+    uint32_t reserved;
+};
+
+struct TiledTextureTile {
+    uint64_t offset;                // compressed bytes in the file
+    uint32_t size;
+    uint32_t reserved;
+};
+
+// True if the file starts with the .rttx magic
+inline bool is_tiled_texture(const string& path) {
+    ifstream in(path, ios::binary);
+    char magic[4] = {};
+    in.read(magic, 4);
+    return in && memcmp(magic, TILED_TEXTURE_MAGIC, 4) == 0;
+}
+
+// Next mip level of an RGB8 image: 2x2 box filter, both sides halved (at least 1)
+inline vector<unsigned char> downsample_rgb8(const unsigned char* src, int sw, int sh, int& w, int& h) {
+    w = max(1, sw / 2);
+    h = max(1, sh / 2);
+    vector<unsigned char> dst(size_t(w) * h * 3);
+#pragma omp parallel for
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            int xs[2] = {min(2 * x, sw - 1), min(2 * x + 1, sw - 1)};
+            int ys[2] = {min(2 * y, sh - 1), min(2 * y + 1, sh - 1)};
+            for (int c = 0; c < 3; ++c) {
+                int sum = 0;
+                for (int yy : ys) for (int xx : xs) sum += src[(size_t(yy) * sw + xx) * 3 + c];
+                dst[(size_t(y) * w + x) * 3 + c] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+    }
+    return dst;
+}
+
+class TextureCache;
+
+// One opened .rttx file. Texel reads go through TextureCache::global().
+class TiledTexture {
+public:
+    TiledTexture(const string& path, uint32_t id) : path_(path), id_(id), file_(path) {
+        if (!file_.is_open()) throw runtime_error("cannot open " + path);
+        if (file_.size() < sizeof(TiledTextureHeader)) throw runtime_error(path + ": file too small");
+        memcpy(&header_, file_.data(), sizeof(header_));
+        if (memcmp(header_.magic, TILED_TEXTURE_MAGIC, 4) != 0) throw runtime_error(path + ": not a .rttx texture");
+        if (header_.version != TILED_TEXTURE_VERSION) throw runtime_error(path + ": unsupported .rttx version, convert it again with texconvert");
+        if (header_.tile_size == 0 || header_.num_levels == 0) throw runtime_error(path + ": bad header");
+        size_t levels_at = sizeof(TiledTextureHeader);
+        size_t tiles_at = levels_at + header_.num_levels * sizeof(TiledTextureLevel);
+        if (tiles_at + size_t(header_.num_tiles) * sizeof(TiledTextureTile) > file_.size()) {
+            throw runtime_error(path + ": tables out of range");
+        }
+        levels_.resize(header_.num_levels);
+        memcpy(levels_.data(), file_.data() + levels_at, levels_.size() * sizeof(TiledTextureLevel));
+        tiles_ = reinterpret_cast<const TiledTextureTile*>(file_.data() + tiles_at);
+        for (const TiledTextureLevel& l : levels_) {
+            if (uint64_t(l.first_tile) + uint64_t(l.tiles_x) * l.tiles_y > header_.num_tiles) {
+                throw runtime_error(path + ": level out of range");
+            }
+        }
+        for (uint32_t i = 0; i < header_.num_tiles; ++i) {
+            if (tiles_[i].offset + tiles_[i].size > file_.size()) throw runtime_error(path + ": tile out of range");
+        }
+    }
+
+    const string& path() const { return path_; }
+    uint32_t id() const { return id_; }
+    int width() const { return header_.width; }
+    int height() const { return header_.height; }
+    int num_levels() const { return int(levels_.size()); }
+    int level_width(int level) const { return levels_[level].width; }
+    int level_height(int level) const { return levels_[level].height; }
+    size_t tile_bytes() const { return size_t(header_.tile_size) * header_.tile_size * 3; }
+
+    // RGB8 of texel (x, y) of 'level', x and y inside the level. Valid until this thread
+    // reads another tile of the same table slot, copy it out right away.
+    inline const unsigned char* texel(int level, int x, int y) const;
+
+    // Inflate tile 'index' into 'out' (tile_bytes() bytes). A corrupt tile reads as black.
+    bool decode_tile(uint32_t index, unsigned char* out) const {
+        const TiledTextureTile& t = tiles_[index];
+        int n = stbi_zlib_decode_buffer(reinterpret_cast<char*>(out), int(tile_bytes()),
+                                        file_.data() + t.offset, int(t.size));
+        if (n == int(tile_bytes())) return true;
+        memset(out, 0, tile_bytes());
+        return false;
+    }
+
+private:
+    string path_;
+    uint32_t id_;
+    MappedFile file_;
+    TiledTextureHeader header_;
+    vector<TiledTextureLevel> levels_;
+    const TiledTextureTile* tiles_ = nullptr;
+};
+
+// Process-wide cache of inflated tiles with an LRU under a byte budget
+class TextureCache {
+public:
+    using Tile = vector<unsigned char>;
+
+    static TextureCache& global() {
+        static TextureCache cache;
+        return cache;
+    }
+
+    void set_budget(size_t bytes) {
+        lock_guard<mutex> lock(mutex_);
+        budget_ = bytes;
+        evict();
+    }
+    size_t budget() const { return budget_; }
+
+    // Opened once per path, later calls share it. Opened again under a new id once the
+    // file's modification time or size changed, holders of the old version keep it.
+    shared_ptr<TiledTexture> open(const string& path) {
+        error_code ec;
+        auto mtime = filesystem::last_write_time(path, ec);
+        uintmax_t size = ec ? 0 : filesystem::file_size(path, ec);
+        lock_guard<mutex> lock(mutex_);
+        auto it = textures_.find(path);
+        if (it != textures_.end() && it->second.mtime == mtime && it->second.size == size) return it->second.texture;
+        auto tex = make_shared<TiledTexture>(path, next_id_++);
+        textures_[path] = {tex, mtime, size};
+        return tex;
+    }
+
+    // The inflated tile, through this thread's table first
+    const unsigned char* tile(const TiledTexture& tex, uint32_t index) {
+        const uint64_t key = (uint64_t(tex.id()) << 32) | index;
+        LocalSlot& slot = local_slots()[hash_key(key) & (LOCAL_SLOTS - 1)];
+        if (slot.tile && slot.key == key) return slot.tile->data();
+        slot.tile = shared_tile(tex, index, key);
+        slot.key = key;
+        return slot.tile->data();
+    }
+
+    // Reads served by the thread tables are not counted, they would cost a shared counter
+    struct Stats {
+        uint64_t shared_hits, decodes, evictions;
+        size_t resident_bytes;
+    };
+    Stats stats() {
+        lock_guard<mutex> lock(mutex_);
+        return {shared_hits_, decodes_, evictions_, resident_bytes_};
+    }
+
+private:
+    // Tiles a thread holds on to, even after the shared cache dropped them. Not counted in
+    // the budget: up to LOCAL_SLOTS * tile_bytes() more per thread (768 KB for 64x64 tiles).
+    static constexpr size_t LOCAL_SLOTS = 64;
+    struct LocalSlot {
+        uint64_t key = 0;
+        shared_ptr<const Tile> tile;
+    };
+
+    struct Entry {
+        shared_ptr<const Tile> tile;
+        list<uint64_t>::iterator lru_pos;
+    };
+
+    mutex mutex_;
+    size_t budget_ = size_t(256) << 20;
+    size_t resident_bytes_ = 0;
+    struct OpenTexture {
+        shared_ptr<TiledTexture> texture;
+        filesystem::file_time_type mtime;
+        uintmax_t size;
+    };
+    unordered_map<string, OpenTexture> textures_;
+    uint32_t next_id_ = 0;
+    unordered_map<uint64_t, Entry> tiles_;
+    list<uint64_t> lru_;                // front = most recently used
+    uint64_t shared_hits_ = 0, decodes_ = 0, evictions_ = 0;
+
+    static uint64_t hash_key(uint64_t k) {
+        k ^= k >> 33; k *= 0xff51afd7ed558ccdull;
+        k ^= k >> 33;
+        return k;
+    }
+
+    static LocalSlot* local_slots() {
+        static thread_local LocalSlot slots[LOCAL_SLOTS];
+        return slots;
+    }
+
+    shared_ptr<const Tile> shared_tile(const TiledTexture& tex, uint32_t index, uint64_t key) {
+        {
+            lock_guard<mutex> lock(mutex_);
+            auto it = tiles_.find(key);
+            if (it != tiles_.end()) {
+                ++shared_hits_;
+                lru_.splice(lru_.begin(), lru_, it->second.lru_pos);
+                return it->second.tile;
+            }
+        }
+        // Inflate without the lock, other threads keep reading meanwhile
+        auto tile = make_shared<Tile>(tex.tile_bytes());
+        if (!tex.decode_tile(index, tile->data())) {
+            cerr << tex.path() << ": corrupt tile " << index << ", reading it as black\n";
+        }
+
+        lock_guard<mutex> lock(mutex_);
+        auto it = tiles_.find(key);
+        if (it != tiles_.end()) return it->second.tile;     // another thread was faster
+        ++decodes_;
+        lru_.push_front(key);
+        tiles_.emplace(key, Entry{tile, lru_.begin()});
+        resident_bytes_ += tile->size();
+        evict();
+        return tile;
+    }
+
+    // Drop least recently used tiles until the budget holds (always keeps the newest one)
+    void evict() {
+        while (resident_bytes_ > budget_ && lru_.size() > 1) {
+            auto it = tiles_.find(lru_.back());
+            resident_bytes_ -= it->second.tile->size();
+            tiles_.erase(it);
+            lru_.pop_back();
+            ++evictions_;
+        }
+    }
+};
+
+inline const unsigned char* TiledTexture::texel(int level, int x, int y) const {
+    const TiledTextureLevel& l = levels_[level];
+    const uint32_t ts = header_.tile_size;
+    uint32_t index = l.first_tile + (uint32_t(y) / ts) * l.tiles_x + uint32_t(x) / ts;
+    return TextureCache::global().tile(*this, index) + ((uint32_t(y) % ts) * ts + uint32_t(x) % ts) * 3;
+}
+
+#endif
@@ -0,0 +1,80 @@
+// Tone mapping: HDR .pfm render (myraytracer --hdr) -> 8-bit .png / .ppm, without tracing again.
+//
+// Build: g++ -std=c++17 -O2 -o tonemap src/tonemap.cpp
+// Usage: ./tonemap out/out.pfm out/tonemapped.png [--exposure EV] [--op maxscale|clamp|reinhard|aces] [--gamma G]
+// Defaults (exposure 0, maxscale, gamma 1) give the same pixels as the renderer's own out.png.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "include/stb_image_write.h"
+
+#include "vec3.h"
+#include "image.h"
+
+using namespace std;
+
+// Reinhard per channel
+static float reinhard(float x) { return x / (1.f + x); }
+
+// ACES filmic curve, Narkowicz fit
+static float aces(float x) {
+    return clamp((x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f), 0.f, 1.f);
+}
+
+int main(int argc, char* argv[]) {
+    vector<string> files;
+    float exposure = 0, gamma = 1;
+    string op = "maxscale";
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string a = argv[i];
+            if (a == "--exposure" && i + 1 < argc) exposure = stof(argv[++i]);
+            else if (a == "--op" && i + 1 < argc) op = argv[++i];
+            else if (a == "--gamma" && i + 1 < argc) gamma = stof(argv[++i]);
+            else files.push_back(a);
+        }
+    } catch (...) {
+        files.clear();
+    }
+    if (files.size() != 2 || gamma <= 0 || (op != "maxscale" && op != "clamp" && op != "reinhard" && op != "aces")) {
+        cerr << "Usage: " << argv[0] << " <in.pfm> <out.png|out.ppm> [--exposure EV]"
+             << " [--op maxscale|clamp|reinhard|aces] [--gamma G]\n";
+        return 1;
+    }
+
+    int width, height;
+    vector<vec3> hdr;
+    if (!load_pfm(files[0], width, height, hdr)) {
+        cerr << "Failed to read " << files[0] << " (expected a PF or Pf file)\n";
+        return 1;
+    }
+
+    const float scale = exp2(exposure);
+    for (vec3& c : hdr) {
+        c = c * scale;
+        if (op == "reinhard") c = vec3{reinhard(c.x), reinhard(c.y), reinhard(c.z)};
+        else if (op == "aces") c = vec3{aces(c.x), aces(c.y), aces(c.z)};
+        else if (op == "clamp") c = vec3{clamp(c.x, 0.f, 1.f), clamp(c.y, 0.f, 1.f), clamp(c.z, 0.f, 1.f)};
+        // maxscale: to_rgb8 divides by max(1, max channel), like the renderer's own output
+        if (gamma != 1) {
+            float m = op == "maxscale" ? max(1.f, max(c.x, max(c.y, c.z))) : 1.f;
+            c = vec3{powf(max(c.x / m, 0.f), 1 / gamma), powf(max(c.y / m, 0.f), 1 / gamma),
+                     powf(max(c.z / m, 0.f), 1 / gamma)};
+        }
+    }
+
+    string out = files[1];
+    bool ok = out.size() >= 4 && out.compare(out.size() - 4, 4, ".ppm") == 0 ? save_ppm(out, width, height, hdr)
+                                                                             : save_png(out, width, height, hdr);
+    if (!ok) {
+        cerr << "Failed to write " << out << "\n";
+        return 1;
+    }
+    cout << "Wrote " << out << " (" << width << "x" << height << ", " << op << ", exposure " << exposure
+         << " EV, gamma " << gamma << ")" << endl;
+    return 0;
+}
@@ -63,4 +63,9 @@ inline vec3 cross(const vec3& a, const vec3& b) {
     };
 }
 
+// Component-wise product (colors: light times surface color)
+inline vec3 mul(const vec3& a, const vec3& b) {
+    return { a.x * b.x, a.y * b.y, a.z * b.z };
+}
+
 #endif 